@@ -0,0 +1,54 @@
+#include "include/BufferPool.h"
+
+size_t BufferPool::sizeClass(size_t size) {
+	size_t sizeClass = 4096;
+	while (sizeClass < size) {
+		sizeClass *= 2;
+	}
+	return sizeClass;
+}
+
+bool BufferPool::reserve(cl::Buffer& buffer, size_t& capacity, size_t size) {
+	size_t wanted = sizeClass(size);
+
+	lock_guard<mutex> lock(poolMutex);
+	statistics.requests++;
+
+	// The buffer already held is of the right class
+	if (capacity == wanted) {
+		statistics.hits++;
+		return false;
+	}
+
+	// Take the most recently returned buffer of the class, which keeps the buffer handles stable when one equaliser alternates between sizes
+	// Otherwise allocate one, before the held buffer is returned, so that a failed allocation leaves the buffer and the pool as they were
+	vector<cl::Buffer>& available = freeBuffers[wanted];
+	cl::Buffer replacement;
+	bool allocated = available.empty();
+	if (allocated) {
+		replacement = cl::Buffer(context, CL_MEM_READ_WRITE, wanted);
+		statistics.allocations++;
+		statistics.allocatedBytes += wanted;
+	}
+	else {
+		replacement = available.back();
+		available.pop_back();
+		statistics.freeBytes -= wanted;
+		statistics.hits++;
+	}
+
+	// Return the buffer to the pool, so that a later request of its class can reuse it
+	if (capacity > 0) {
+		freeBuffers[capacity].push_back(buffer);
+		statistics.freeBytes += capacity;
+	}
+
+	buffer = replacement;
+	capacity = wanted;
+	return allocated;
+}
+
+BufferPoolStatistics BufferPool::getStatistics() const {
+	lock_guard<mutex> lock(poolMutex);
+	return statistics;
+}
@@ -22,6 +22,12 @@ Description
 #include <iostream>
 #include <vector>
 #include "include/Utils.h"
+#include "include/HistogramEqualiser.h"
+#include "include/EqualiserServer.h"
+#include "include/MetricsRecorder.h"
+#include "include/MultiDeviceScheduler.h"
+#include "include/RooflineReport.h"
+#include "include/ScopedTimer.h"
 #include "include/CImg.h"
 
 using namespace cimg_library;
@@ -45,6 +51,51 @@ void printHelp() {
 	// Prompt to input an image file
 	std::cerr << "  -f : input image file (Default: test.pgm)" << std::endl;
 
+	// Prompt to select the colour mode for RGB images
+	std::cerr << "  -c : colour mode for RGB images, ycbcr, rgb, hsv, hsl or lab (Default: ycbcr)" << std::endl;
+
+	// Prompt to match the histogram of a reference image
+	std::cerr << "  -r : reference image file for histogram matching" << std::endl;
+
+	// Prompt to match a stored target cumulative histogram
+	std::cerr << "  -t : target cumulative histogram file for histogram matching" << std::endl;
+
+	// Prompt to store the target cumulative histogram
+	std::cerr << "  -w : write the target cumulative histogram to a file" << std::endl;
+
+	// Prompt to serve the image through a pool of workers
+	std::cerr << "  -s : serve copies of the image through this many worker queues and report latency and throughput" << std::endl;
+
+	// Prompt to split a batch across every device
+	std::cerr << "  -m : equalise this many copies of the image across every device and report the throughput of each" << std::endl;
+
+	// Prompt to split the batch or the bands across NUMA nodes
+	std::cerr << "  -n : with -m or -b, partition the selected device into NUMA sub-devices instead of using every device" << std::endl;
+
+	// Prompt to split the image across devices
+	std::cerr << "  -b : split the rows of the image into a band per device, or per NUMA sub-device with -n, and compare with the single-device output" << std::endl;
+
+	// Prompt to export the timings
+	std::cerr << "  -o : write the timings and transfer rates of every kernel and transfer to a JSON file, or CSV when the name ends with .csv" << std::endl;
+
+	// Prompt to write a timeline
+	std::cerr << "  -e : write a timeline of the host steps and the device commands to a trace file for Perfetto or about:tracing" << std::endl;
+
+	// Prompt to compare the kernels with the device ceilings
+	std::cerr << "  -k : measure the copy bandwidth and atomic throughput of the device and report the efficiency of each kernel against them" << std::endl;
+
+	// Prompt to specialise the kernels
+	std::cerr << "  -u : build the kernels with the bin count and bit depth fixed at compile time, so that the compiler can unroll and strength-reduce them" << std::endl;
+
+	// Prompt to use the image pipeline
+	std::cerr << "  -i : upload the intensity plane as an image and run the histogram and back-projection on it in 2D tiles, replacing the selected kernels" << std::endl;
+
+	// Prompt to launch the pixel stages over row tiles
+	std::cerr << "  -g : run the histogram and back-projection over 2D row tiles of WxH work items, each covering N pixels of its row with WxHxN (Default: 16x16x1), replacing the selected kernels" << std::endl;
+
+	// Prompt to launch the pixel stages as persistent work groups
+	std::cerr << "  -q : run the histogram and back-projection as this many work groups per compute unit, each looping over the image, replacing the selected kernels" << std::endl;
+
 	// Prompt to display the instructions again
 	std::cerr << "  -h : print this message" << std::endl;
 }
@@ -64,6 +115,25 @@ void printProfiling(string step, string kernelFunctionName, cl::Event kernelEven
 	std::cout << std::endl << "--------------------------------------------------" << std::endl;
 }
 
+// A function to read a stored target cumulative histogram, with one value per line
+vector<int> loadTargetCDF(string fileName) {
+	vector<int> targetCDF;
+	ifstream file(fileName);
+	int value;
+	while (file >> value) {
+		targetCDF.push_back(value);
+	}
+	return targetCDF;
+}
+
+// A function to store a target cumulative histogram, with one value per line
+void saveTargetCDF(string fileName, const vector<int>& targetCDF) {
+	ofstream file(fileName);
+	for (int value : targetCDF) {
+		file << value << "\n";
+	}
+}
+
 // A function to display the output image, varied by bit depth
 CImgDisplay displayImage(CImg<modularImage> image, bool is16BitUsed, string peripheral) {
 	// Check the bit depth
@@ -88,6 +158,48 @@ int main(int argc, char** argv) {
 	// Set the default image file to test.pgm
 	string imgFile = "test.pgm";
 
+	// Set the default colour mode to equalise the luma of RGB images
+	string colourMode = "ycbcr";
+
+	// Set the files used for histogram matching, which is disabled when both sources are empty
+	string referenceFile;
+	string targetFile;
+	string saveFile;
+
+	// Set the number of server workers, which is disabled when it is 0
+	int serverWorkers = 0;
+
+	// Set the number of images in the multi-device batch, which is disabled when it is 0
+	int batchSize = 0;
+
+	// Set whether the multi-device batch runs on the NUMA sub-devices of the selected device
+	bool numaFission = false;
+
+	// Set whether the image is split into row bands across the devices
+	bool splitImage = false;
+
+	// Set the file for the timing report, which is disabled when it is empty
+	string metricsFile;
+
+	// Set the file for the timeline, which is disabled when it is empty
+	string traceFile;
+
+	// Set whether the kernels are compared with the measured ceilings of the device
+	bool rooflineReport = false;
+
+	// Set whether the kernels are built for the selected bin count and bit depth
+	bool specialise = false;
+
+	// Set whether the intensity plane is read and written as an image
+	bool imagePipeline = false;
+
+	// Set the shape of the row tiles, and whether the tiled kernels replace the selected ones
+	string tileShape = "16x16x1";
+	bool tiledLaunch = false;
+
+	// Set the number of persistent work groups per compute unit, where 0 keeps the selected kernels
+	int groupsPerComputeUnit = 0;
+
 	// Iterate through the command line arguments
 	for (int i = 1; i < argc; i++) {
 		// Set the platform ID as the selected platform
@@ -102,10 +214,78 @@ int main(int argc, char** argv) {
 		// Set the image file name as the selected image file
 		else if ((strcmp(argv[i], "-f") == 0) && (i < (argc - 1))) { imgFile = argv[++i]; }
 
+		// Set the colour mode for RGB images
+		else if ((strcmp(argv[i], "-c") == 0) && (i < (argc - 1))) { colourMode = argv[++i]; }
+
+		// Set the reference image file for histogram matching
+		else if ((strcmp(argv[i], "-r") == 0) && (i < (argc - 1))) { referenceFile = argv[++i]; }
+
+		// Set the target cumulative histogram file for histogram matching
+		else if ((strcmp(argv[i], "-t") == 0) && (i < (argc - 1))) { targetFile = argv[++i]; }
+
+		// Set the file to store the target cumulative histogram
+		else if ((strcmp(argv[i], "-w") == 0) && (i < (argc - 1))) { saveFile = argv[++i]; }
+
+		// Set the number of server workers
+		else if ((strcmp(argv[i], "-s") == 0) && (i < (argc - 1))) { serverWorkers = atoi(argv[++i]); }
+
+		// Set the number of images in the multi-device batch
+		else if ((strcmp(argv[i], "-m") == 0) && (i < (argc - 1))) { batchSize = atoi(argv[++i]); }
+
+		// Partition the selected device by NUMA node for the multi-device batch
+		else if (strcmp(argv[i], "-n") == 0) { numaFission = true; }
+
+		// Split the image into row bands across the devices
+		else if (strcmp(argv[i], "-b") == 0) { splitImage = true; }
+
+		// Set the file for the timing report
+		else if ((strcmp(argv[i], "-o") == 0) && (i < (argc - 1))) { metricsFile = argv[++i]; }
+
+		// Set the file for the timeline
+		else if ((strcmp(argv[i], "-e") == 0) && (i < (argc - 1))) { traceFile = argv[++i]; }
+
+		// Compare the kernels with the measured ceilings of the device
+		else if (strcmp(argv[i], "-k") == 0) { rooflineReport = true; }
+
+		// Build the kernels for the selected bin count and bit depth
+		else if (strcmp(argv[i], "-u") == 0) { specialise = true; }
+
+		// Read and write the intensity plane as an image
+		else if (strcmp(argv[i], "-i") == 0) { imagePipeline = true; }
+
+		// Launch the histogram and back-projection over row tiles of the given shape
+		else if ((strcmp(argv[i], "-g") == 0) && (i < (argc - 1))) { tileShape = argv[++i]; tiledLaunch = true; }
+
+		// Launch the histogram and back-projection as persistent work groups
+		else if ((strcmp(argv[i], "-q") == 0) && (i < (argc - 1))) { groupsPerComputeUnit = atoi(argv[++i]); }
+
 		// Display the instructions and terminate the program
 		else if (strcmp(argv[i], "-h") == 0) { printHelp(); return 0; }
 	}
 
+	// Check that the colour mode is one of the supported colour spaces
+	if (colourMode != "ycbcr" && colourMode != "rgb" && colourMode != "hsv" && colourMode != "hsl" && colourMode != "lab") {
+		std::cerr << "ERROR: unknown colour mode " << colourMode << std::endl;
+		printHelp();
+		return 1;
+	}
+
+	// Check that the NUMA partition is only requested for the multi-device batch or the row bands, which are the only paths that use it
+	if (numaFission && batchSize <= 0 && !splitImage) {
+		std::cerr << "ERROR: -n needs -m or -b" << std::endl;
+		printHelp();
+		return 1;
+	}
+
+	// Check that the tile has a positive width and height, and that every work item covers at least one pixel
+	int tileWidth = 0, tileHeight = 0, itemsPerThread = 1;
+	int tileFields = sscanf(tileShape.c_str(), "%dx%dx%d", &tileWidth, &tileHeight, &itemsPerThread);
+	if (tileFields < 2 || tileWidth < 1 || tileHeight < 1 || itemsPerThread < 1) {
+		std::cerr << "ERROR: invalid tile shape " << tileShape << std::endl;
+		printHelp();
+		return 1;
+	}
+
 	// Disable CImg library exception handling
 	cimg::exception_mode(0);
 
@@ -130,14 +310,21 @@ int main(int argc, char** argv) {
 	// A variable to store whether a 16-bit image was used
 	bool is16BitUsed;
 
-	// A variable to store whether an RGB image was used
-	bool rgbUsed;
+	// A variable to store whether the RGB channels are equalised independently
+	bool perChannel = false;
 
 	// A variable to store the max intensity of the look-up table
 	int maxIntensity = 255;
 
-	// A variable to store the console output for 8 and 16-bit
-	int consoleVariant = 256;
+	// A variable to store whether the histogram is matched to a target rather than equalised
+	bool histogramMatching = !referenceFile.empty() || !targetFile.empty();
+
+	// Time the host steps from here on, adding them to the timeline when one is written
+	StageTimers timers;
+	TraceWriter trace;
+	if (!traceFile.empty()) {
+		timers.setTrace(&trace);
+	}
 
 	// Try to apply the histogram equalisation algorithm
 	try {
@@ -145,53 +332,75 @@ int main(int argc, char** argv) {
 		STEP 1 ---------------- IMAGE PREPARATION ----------------
 		*/
 
+		ScopedTimer stepTimer1(timers, "Image Preparation");
+
 		// Open the image file
+		ScopedTimer loadTimer(timers, "Load Image");
 		CImg<unsigned short> imgInput(imgFile.c_str());
+		loadTimer.stop();
 
 		std::cout << "Loaded image is " << imgFile << std::endl;
 
 		// Check if the image is 16-bit
+		ScopedTimer depthTimer(timers, "Bit Depth Check");
 		if (imgInput.max() <= 255) {
 			std::cout << "Loaded image is 8-bit." << std::endl;
 			is16BitUsed = false;
 			maxIntensity = 255;
-			consoleVariant = 256;
 		}
 		else if (imgInput.max() <= 65535) {
 			std::cout << "Loaded image is 16-bit." << std::endl;
 			is16BitUsed = true;
 			maxIntensity = 65535;
-			consoleVariant = 65536;
 		}
+		depthTimer.stop();
 
 		// Display the original input image
+		ScopedTimer displayInputTimer(timers, "Display Input");
 		CImgDisplay displayInput = displayImage(imgInput, is16BitUsed, "Input");
-
-		// RGB to YCbCr Conversion
-		CImg<unsigned short> cbChannel, crChannel;
+		displayInputTimer.stop();
 
 		if (imgInput.spectrum() == 1) {
 			std::cout << "Loaded image is greyscale." << std::endl;
-			imgInput = imgInput;
-			rgbUsed = false;
+		}
+		else if (imgInput.spectrum() == 3 && colourMode == "rgb" && !histogramMatching) {
+			std::cout << "Loaded image is RGB, equalising each channel." << std::endl;
+
+			// Keep all three channels, which CImg stores one plane after another
+			perChannel = true;
+		}
+		else if (imgInput.spectrum() == 3 && (colourMode == "hsv" || colourMode == "hsl" || colourMode == "lab")) {
+			std::cout << "Loaded image is RGB, equalising in " << colourMode << "." << std::endl;
 		}
 		else if (imgInput.spectrum() == 3) {
 			std::cout << "Loaded image is RGB." << std::endl;
-			rgbUsed = true;
+		}
 
-			// Convert RGB image to YCbCr
-			CImg<unsigned short> ycbcrImage = imgInput.get_RGBtoYCbCr();
+		// The split mode divides a single intensity plane, so it cannot be used with the per-channel or device colour modes
+		if (splitImage && imgInput.spectrum() == 3 && (perChannel || colourMode == "hsv" || colourMode == "hsl" || colourMode == "lab")) {
+			std::cerr << "ERROR: -b only supports greyscale images and the ycbcr colour mode" << std::endl;
+			return 1;
+		}
+
+		// Open the reference image for histogram matching, whose luma channel is used when it is RGB
+		CImg<unsigned short> imgReference;
+
+		if (!referenceFile.empty()) {
+			ScopedTimer referenceTimer(timers, "Load Reference");
+			imgReference.assign(referenceFile.c_str());
 
-			// Extract the channels setting y as the input image
-			imgInput = ycbcrImage.get_channel(0);
-			cbChannel = ycbcrImage.get_channel(1);
-			crChannel = ycbcrImage.get_channel(2);
+			std::cout << "Loaded reference image is " << referenceFile << std::endl;
 		}
 
 		/*
 		STEP 2 ---------------- MODEL SELECTION ----------------
 		*/
 
+		stepTimer1.stop();
+
+		// The menus wait for the user, so they are timed as well
+		ScopedTimer stepTimer2(timers, "Model Selection");
+
 		// Prompt to enter a bin count
 		std::cout << "Enter a bin count between 1 and 256: " << "\n";
 
@@ -217,259 +426,239 @@ int main(int argc, char** argv) {
 			else { std::cout << "Please enter a number in between 1 and 256: " << "\n"; continue; }
 		}
 
-		// Prompt to enter a selection for the intensity histogram
-		std::cout << "\n" << "Enter an option for the intensity histogram: " << "\n";
-		std::cout << "1) Standardised Implementation" << "\n";
-		std::cout << "2) Variable Implementation" << "\n";
-		std::cout << "3) Local Memory Implementation" << "\n";
+		// The per-channel mode builds the three histograms in one kernel, scans them in one batched launch of the fused look-up table, and back-projects all channels together
+		if (perChannel) {
+			intHistoChoice = 4;
+			cumHistoChoice = 5;
+			backprojectChoice = 4;
+		}
+		else {
+			// Prompt to enter a selection for the intensity histogram
+			std::cout << "\n" << "Enter an option for the intensity histogram: " << "\n";
+			std::cout << "1) Standardised Implementation" << "\n";
+			std::cout << "2) Variable Implementation" << "\n";
+			std::cout << "3) Local Memory Implementation" << "\n";
 
-		// Loop until a valid input has been received
-		while (true)
-		{
-			// Store user input in the pre-made variable
-			getline(std::cin, userInput);
+			// Loop until a valid input has been received
+			while (true)
+			{
+				// Store user input in the pre-made variable
+				getline(std::cin, userInput);
 
-			// Check if the user input is an empty string and prompt the user to enter a valid input
-			if (userInput == "") { std::cout << "Please enter a number." << "\n"; continue; }
+				// Check if the user input is an empty string and prompt the user to enter a valid input
+				if (userInput == "") { std::cout << "Please enter a number." << "\n"; continue; }
 
-			// Try to convert the user input to an integer and store it in the pre-made variable
-			try { intHistoChoice = std::stoi(userInput); }
+				// Try to convert the user input to an integer and store it in the pre-made variable
+				try { intHistoChoice = std::stoi(userInput); }
 
-			// If the user input is not an integer, catch the exception and prompt the user for a valid input
-			catch (...) { std::cout << "Please enter an integer." << "\n"; continue; }
+				// If the user input is not an integer, catch the exception and prompt the user for a valid input
+				catch (...) { std::cout << "Please enter an integer." << "\n"; continue; }
 
-			// Check if the user input is in the range of 1 and the maximum, and exit with the break statement
-			if (intHistoChoice >= 1 && intHistoChoice <= 3) { break; }
+				// The standardised histogram indexes the bins by intensity, so it is only valid with a bin for every intensity level
+				if (intHistoChoice == 1 && binCount != maxIntensity + 1) { std::cout << "The standardised histogram needs " << maxIntensity + 1 << " bins, please choose another option: " << "\n"; continue; }
 
-			// If the user input is not within the valid range, prompt the user to enter a valid input
-			else { std::cout << "Please enter a number between 1 and 3: " << "\n"; continue; }
-		}
+				// Check if the user input is in the range of 1 and the maximum, and exit with the break statement
+				if (intHistoChoice >= 1 && intHistoChoice <= 3) { break; }
 
-		// Switch the kernel according to choice.
-		string intHistoFunction;
-		switch (intHistoChoice) {
-			case 1:
-				intHistoFunction = "intHistogram";
-				break;
-			case 2:
-				intHistoFunction = "intHistogram2";
-				break;
-			case 3:
-				intHistoFunction = "intHistogram3";
-				break;
+				// If the user input is not within the valid range, prompt the user to enter a valid input
+				else { std::cout << "Please enter a number between 1 and 3: " << "\n"; continue; }
+			}
 		}
 
-		// Prompt to enter a selection for the cumulative histogram
-		std::cout << "\n" << "Enter an option for the cumulative histogram: " << "\n";
-		std::cout << "1) Serial Implementation" << "\n";
-		std::cout << "2) Blelloch Implementation" << "\n";
-		std::cout << "3) Hillis-Steele Implementation" << "\n";
-		std::cout << "4) Double Buffered Hillis-Steele Implementation" << "\n";
+		// Prompt for the cumulative histogram unless it was set by the per-channel mode
+		if (!perChannel) {
+			// Prompt to enter a selection for the cumulative histogram
+			std::cout << "\n" << "Enter an option for the cumulative histogram: " << "\n";
+			std::cout << "1) Serial Implementation" << "\n";
+			std::cout << "2) Blelloch Implementation" << "\n";
+			std::cout << "3) Hillis-Steele Implementation" << "\n";
+			std::cout << "4) Double Buffered Hillis-Steele Implementation" << "\n";
+			std::cout << "5) Double Buffered Hillis-Steele Implementation with Normalised Look-up Table" << "\n";
 
-		// Loop until a valid input has been received
-		while (true)
-		{
-			// Store user input in the pre-made variable
-			getline(std::cin, userInput);
+			// Loop until a valid input has been received
+			while (true)
+			{
+				// Store user input in the pre-made variable
+				getline(std::cin, userInput);
 
-			// Check if the user input is an empty string and prompt the user to enter a valid input
-			if (userInput == "") { std::cout << "Please enter a number." << "\n"; continue; }
+				// Check if the user input is an empty string and prompt the user to enter a valid input
+				if (userInput == "") { std::cout << "Please enter a number." << "\n"; continue; }
 
-			// Try to convert the user input to an integer and store it in the pre-made variable
-			try { cumHistoChoice = std::stoi(userInput); }
+				// Try to convert the user input to an integer and store it in the pre-made variable
+				try { cumHistoChoice = std::stoi(userInput); }
 
-			// If the user input is not an integer, catch the exception and prompt the user for a valid input
-			catch (...) { std::cout << "Please enter an integer." << "\n"; continue; }
+				// If the user input is not an integer, catch the exception and prompt the user for a valid input
+				catch (...) { std::cout << "Please enter an integer." << "\n"; continue; }
 
-			// Check if the user input is in the range of 1 and the maximum, and exit with the break statement
-			if (cumHistoChoice >= 1 && cumHistoChoice <= 4) { break; }
+				// Histogram matching compares against the last cumulative value as the pixel count, so it needs one of the inclusive scans
+				if (histogramMatching && (cumHistoChoice == 1 || cumHistoChoice == 2)) { std::cout << "Histogram matching needs an inclusive scan, please enter 3, 4 or 5: " << "\n"; continue; }
 
-			// If the user input is not within the valid range, prompt the user to enter a valid input
-			else { std::cout << "Please enter a number between 1 and 4: " << "\n"; continue; }
-		}
+				// The Blelloch scan halves the bins at every level, so it is only valid for a power of two
+				if (cumHistoChoice == 2 && (binCount & (binCount - 1)) != 0) { std::cout << "The Blelloch implementation needs a power of two bins, please choose another option: " << "\n"; continue; }
 
-		// Switch the kernel according to choice.
-		string cumHistoFunction;
-		switch (cumHistoChoice) {
-			case 1:
-				cumHistoFunction = "cumHistogram";
-				break;
-			case 2:
-				cumHistoFunction = "cumHistogramB";
-				break;
-			case 3:
-				cumHistoFunction = "cumHistogramHS";
-				break;
-			case 4:
-				cumHistoFunction = "cumHistogramHS2";
-				break;
+				// Check if the user input is in the range of 1 and the maximum, and exit with the break statement
+				if (cumHistoChoice >= 1 && cumHistoChoice <= 5) { break; }
+
+				// If the user input is not within the valid range, prompt the user to enter a valid input
+				else { std::cout << "Please enter a number between 1 and 5: " << "\n"; continue; }
+			}
 		}
 
-		// Prompt to enter a selection for the look-up table
-		std::cout << "\n" << "Enter an option for the look-up table: " << "\n";
-		std::cout << "1) Standardised Implementation" << "\n";
-		std::cout << "2) Variable Implementation" << "\n";
-		std::cout << "3) Local Memory Implementation" << "\n";
+		// The fifth cumulative histogram writes the look-up table itself, so the look-up table stage is not launched
+		bool lookupFused = (cumHistoChoice == 5);
 
-		// Loop until a valid input has been received
-		while (true)
-		{
-			// Store user input in the pre-made variable
-			getline(std::cin, userInput);
+		// Prompt for the look-up table only when it is not replaced by histogram matching or fused into the cumulative histogram
+		if (histogramMatching || lookupFused) {
+			lookupChoice = 0;
+		}
+		else {
+			// Prompt to enter a selection for the look-up table
+			std::cout << "\n" << "Enter an option for the look-up table: " << "\n";
+			std::cout << "1) Standardised Implementation" << "\n";
+			std::cout << "2) Variable Implementation" << "\n";
+			std::cout << "3) Local Memory Implementation" << "\n";
+			std::cout << "4) Fixed-Point Implementation" << "\n";
 
-			// Check if the user input is an empty string and prompt the user to enter a valid input
-			if (userInput == "") { std::cout << "Please enter a number." << "\n"; continue; }
+			// Loop until a valid input has been received
+			while (true)
+			{
+				// Store user input in the pre-made variable
+				getline(std::cin, userInput);
 
-			// Try to convert the user input to an integer and store it in the pre-made variable
-			try { lookupChoice = std::stoi(userInput); }
+				// Check if the user input is an empty string and prompt the user to enter a valid input
+				if (userInput == "") { std::cout << "Please enter a number." << "\n"; continue; }
 
-			// If the user input is not an integer, catch the exception and prompt the user for a valid input
-			catch (...) { std::cout << "Please enter an integer." << "\n"; continue; }
+				// Try to convert the user input to an integer and store it in the pre-made variable
+				try { lookupChoice = std::stoi(userInput); }
 
-			// Check if the user input is in the range of 1 and the maximum, and exit with the break statement
-			if (lookupChoice >= 1 && lookupChoice <= 3) { break; }
+				// If the user input is not an integer, catch the exception and prompt the user for a valid input
+				catch (...) { std::cout << "Please enter an integer." << "\n"; continue; }
 
-			// If the user input is not within the valid range, prompt the user to enter a valid input
-			else { std::cout << "Please enter a number between 1 and 3: " << "\n"; continue; }
-		}
+				// The standardised look-up table indexes the cumulative histogram by intensity, so it is only valid with a bin for every intensity level
+				if (lookupChoice == 1 && binCount != maxIntensity + 1) { std::cout << "The standardised look-up table needs " << maxIntensity + 1 << " bins, please choose another option: " << "\n"; continue; }
+
+				// Check if the user input is in the range of 1 and the maximum, and exit with the break statement
+				if (lookupChoice >= 1 && lookupChoice <= 4) { break; }
 
-		// Switch the kernel according to choice.
-		string lookupFunction;
-		switch (lookupChoice) {
-		case 1:
-			lookupFunction = "lookupTable";
-			break;
-		case 2:
-			lookupFunction = "lookupTable2";
-			break;
-		case 3:
-			lookupFunction = "lookupTable3";
-			break;
+				// If the user input is not within the valid range, prompt the user to enter a valid input
+				else { std::cout << "Please enter a number between 1 and 4: " << "\n"; continue; }
+			}
 		}
 
-		// Prompt to enter a selection for the back-projection
-		std::cout << "\n" << "Enter an option for the back-projection: " << "\n";
-		std::cout << "1) Standardised Implementation" << "\n";
-		std::cout << "2) Variable Implementation" << "\n";
-		std::cout << "3) Binary Search Implementation" << "\n";
+		// Prompt for the back-projection unless it was set by the per-channel mode
+		if (!perChannel) {
+			// Prompt to enter a selection for the back-projection
+			std::cout << "\n" << "Enter an option for the back-projection: " << "\n";
+			std::cout << "1) Standardised Implementation" << "\n";
+			std::cout << "2) Variable Implementation" << "\n";
+			std::cout << "3) Binary Search Implementation" << "\n";
 
-		// Loop until a valid input has been received
-		while (true)
-		{
-			// Store user input in the pre-made variable
-			getline(std::cin, userInput);
+			// Loop until a valid input has been received
+			while (true)
+			{
+				// Store user input in the pre-made variable
+				getline(std::cin, userInput);
 
-			// Check if the user input is an empty string and prompt the user to enter a valid input
-			if (userInput == "") { std::cout << "Please enter a number." << "\n"; continue; }
+				// Check if the user input is an empty string and prompt the user to enter a valid input
+				if (userInput == "") { std::cout << "Please enter a number." << "\n"; continue; }
 
-			// Try to convert the user input to an integer and store it in the pre-made variable
-			try { backprojectChoice = std::stoi(userInput); }
+				// Try to convert the user input to an integer and store it in the pre-made variable
+				try { backprojectChoice = std::stoi(userInput); }
 
-			// If the user input is not an integer, catch the exception and prompt the user for a valid input
-			catch (...) { std::cout << "Please enter an integer." << "\n"; continue; }
+				// If the user input is not an integer, catch the exception and prompt the user for a valid input
+				catch (...) { std::cout << "Please enter an integer." << "\n"; continue; }
 
-			// Check if the user input is in the range of 1 and the maximum, and exit with the break statement
-			if (backprojectChoice >= 1 && backprojectChoice <= 3) { break; }
+				// The standardised back-projection indexes the look-up table by intensity, so it is only valid with a bin for every intensity level
+				if (backprojectChoice == 1 && binCount != maxIntensity + 1) { std::cout << "The standardised back-projection needs " << maxIntensity + 1 << " bins, please choose another option: " << "\n"; continue; }
 
-			// If the user input is not within the valid range, prompt the user to enter a valid input
-			else { std::cout << "Please enter a number between 1 and 3: " << "\n"; continue; }
-		}
+				// Check if the user input is in the range of 1 and the maximum, and exit with the break statement
+				if (backprojectChoice >= 1 && backprojectChoice <= 3) { break; }
 
-		// Switch the kernel according to choice.
-		string backprojectFunction;
-		switch (backprojectChoice) {
-		case 1:
-			backprojectFunction = "backprojection";
-			break;
-		case 2:
-			backprojectFunction = "backprojection2";
-			break;
-		case 3:
-			backprojectFunction = "backprojection3";
-			break;
+				// If the user input is not within the valid range, prompt the user to enter a valid input
+				else { std::cout << "Please enter a number between 1 and 3: " << "\n"; continue; }
+			}
 		}
 
 		/*
 		STEP 3 ---------------- MODEL PREPARATION ----------------
 		*/
 
-		// Create an OpenCL context object, with the platform and device to be used
-		cl::Context context = GetContext(platformID, deviceID);
+		stepTimer2.stop();
+		ScopedTimer stepTimer3(timers, "Model Preparation");
+
+		// Create the equaliser, which builds the kernels for the platform and device to be used
+		ScopedTimer buildTimer(timers, "Build Program");
+		HistogramEqualiser equaliser(platformID, deviceID);
+		buildTimer.stop();
 
 		// Print the platform ID and device ID being used
 		std::cout << "\n" << "Running on " << GetPlatformName(platformID) << ", " << GetDeviceName(platformID, deviceID) << std::endl;
 
-		// Enable profiling for the command, to measure the program performance
-		cl::CommandQueue queue(context, CL_QUEUE_PROFILING_ENABLE);
-
-		// Set up the sources for the OpenCL program and add the kernel file, which contains the necessary functions
-		cl::Program::Sources sources;
-		AddSources(sources, "kernels/my_kernels.cl");
-
-		// Create the OpenCL program from the sources
-		cl::Program program(context, sources);
-
-		// Try to build the OpenCL program
-		try {
-			program.build();
+		// The image kernels are not compiled on devices without image support, so fall back to the selected buffer kernels
+		if (imagePipeline && !equaliser.hasImageSupport()) {
+			std::cout << "Device does not support 16-bit single-channel images, using the selected buffer kernels." << std::endl;
+			imagePipeline = false;
 		}
 
-		// If there are errors building the program, output the status, options, and log to the console, and throw the error
-		catch (const cl::Error& err) {
-			std::cout << "Build Status: " << program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
-			std::cout << "Build Options:\t" << program.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
-			std::cout << "Build Log:\t " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
-			throw err;
+		// Gather the selected kernels and the image parameters
+		EqualiserOptions options;
+		options.binCount = binCount;
+		options.intHistoChoice = intHistoChoice;
+		options.cumHistoChoice = cumHistoChoice;
+		options.lookupChoice = lookupChoice;
+		options.backprojectChoice = backprojectChoice;
+		options.colourMode = colourMode;
+		options.maxIntensity = maxIntensity;
+		options.specialise = specialise;
+		options.imagePipeline = imagePipeline;
+		options.tiledLaunch = tiledLaunch;
+		options.tileWidth = tileWidth;
+		options.tileHeight = tileHeight;
+		options.itemsPerThread = itemsPerThread;
+		options.persistentLaunch = (groupsPerComputeUnit > 0);
+		if (groupsPerComputeUnit > 0) {
+			options.groupsPerComputeUnit = groupsPerComputeUnit;
 		}
 
 		/*
-		STEP 4 ---------------- BUFFER PREPARATION ----------------
+		STEP 4 ---------------- TARGET HISTOGRAM ----------------
 		*/
 
-		// Create a vector for the intensity histogram with the size of the user-defined bin count
-		std::vector<int> IH(binCount);
-
-		// Create a vector to determine the size of the increments for the histogram, based upon the bin count
-		std::vector<int> binValues(binCount);
-		int increments = consoleVariant / binCount;
-		for (int i = 0; i < binCount; i++)
-		{
-			binValues[i] = i * increments;
-		}
-
-		// Calculate the total size of the histogram in bytes
-		size_t histoSize = binCount * sizeof(int);
-
-		// Create an OpenCL buffer for the input image
-		cl::Buffer imgInputBuffer(context, CL_MEM_READ_ONLY, imgInput.size() * sizeof(imgInput[0]));
-
-		// Create an OpenCL buffer for the output image
-		cl::Buffer imgOutputBuffer(context, CL_MEM_READ_WRITE, imgInput.size() * sizeof(imgInput[0]));
+		stepTimer3.stop();
+		ScopedTimer stepTimer4(timers, "Target Histogram");
 
-		// Create an OpenCL buffer for the intensity histogram
-		cl::Buffer intHistoBuffer(context, CL_MEM_READ_WRITE, histoSize);
+		// Prepare the target cumulative histogram for histogram matching
+		if (histogramMatching) {
+			// Use the stored target cumulative histogram when one is given
+			if (!targetFile.empty()) {
+				options.targetCDF = loadTargetCDF(targetFile);
 
-		// Create an OpenCL buffer for the cumulative histogram
-		cl::Buffer cumHistoBuffer(context, CL_MEM_READ_WRITE, histoSize);
+				// The stored histogram must use the same bins as the input image
+				if ((int)options.targetCDF.size() != binCount) {
+					std::cerr << "ERROR: " << targetFile << " holds " << options.targetCDF.size() << " values, expected " << binCount << std::endl;
+					return 1;
+				}
+			}
 
-		// Create an OpenCL buffer for the look-up table
-		cl::Buffer lookupBuffer(context, CL_MEM_READ_WRITE, histoSize);
+			// Otherwise build it from the reference image with the binned histogram and the local memory scan
+			else {
+				options.targetCDF = equaliser.targetCDF(imgReference.data(), imgReference.width(), imgReference.height(), imgReference.spectrum(), options);
+			}
 
-		// Create an OpenCL buffer equal to the histogram size
-		cl::Buffer histoSizeBuffer(context, CL_MEM_READ_WRITE, histoSize);
+			// Store the target cumulative histogram so later runs can skip the reference image
+			if (!saveFile.empty()) {
+				saveTargetCDF(saveFile, options.targetCDF);
+			}
+		}
 
 		/*
-		STEP 5 ---------------- INTENSITY HISTOGRAM ----------------
+		STEP 5 ---------------- EQUALISATION ----------------
 		*/
 
-		// Write the input image data to the relevant device buffer
-		queue.enqueueWriteBuffer(imgInputBuffer, CL_TRUE, 0, imgInput.size() * sizeof(imgInput[0]), &imgInput.data()[0]);
-
-		queue.enqueueWriteBuffer(histoSizeBuffer, CL_TRUE, 0, histoSize, &binValues[0]);
+		stepTimer4.stop();
+		ScopedTimer stepTimer5(timers, "Equalisation");
 
-		queue.enqueueFillBuffer(intHistoBuffer, 0, 0, histoSize);
-
-		cl::Device device = queue.getInfo<CL_QUEUE_DEVICE>();
+		cl::Device device = equaliser.getDevice();
 
 		std::cout << std::endl;
 		std::cout << "Max work-group size: " << device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>() << std::endl;
@@ -482,197 +671,168 @@ int main(int argc, char** argv) {
 		std::cout << std::endl;
 		std::cout << "Local memory size: " << device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>() << std::endl;
 
-		int workGroup = binCount;
-		//device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
-		
-		// Prepare the kernel for the intensity histogram
-		cl::Kernel intHistoKernel = cl::Kernel(program, intHistoFunction.c_str());
-
-		// Switch the kernel according to choice.
-		switch (intHistoChoice) {
-			case 1:
-				// Set the arguments for the intensity histogram
-				intHistoKernel.setArg(0, imgInputBuffer);
-				intHistoKernel.setArg(1, intHistoBuffer);
-				break;
-			case 2:
-				// Set the arguments for the intensity histogram
-				intHistoKernel.setArg(0, imgInputBuffer);
-				intHistoKernel.setArg(1, intHistoBuffer);
-				intHistoKernel.setArg(2, binCount);
-				intHistoKernel.setArg(3, increments);
-				break;
-			case 3:
-				// Set the arguments for the intensity histogram
-				intHistoKernel.setArg(0, imgInputBuffer);
-				intHistoKernel.setArg(1, intHistoBuffer);
-				intHistoKernel.setArg(2, (int)imgInput.size());
-				intHistoKernel.setArg(3, binCount);
-				intHistoKernel.setArg(4, histoSizeBuffer);
-				intHistoKernel.setArg(5, cl::Local(histoSize));
-				break;
+		// Copy the decoded image into the pinned memory of the equaliser and equalise it into pinned memory, so that neither transfer needs a staging copy of the runtime
+		ScopedTimer stagingTimer(timers, "Stage Input");
+		uint16_t* inputData = equaliser.stagingInput(imgInput.size());
+		memcpy(inputData, imgInput.data(), imgInput.size() * sizeof(unsigned short));
+		uint16_t* outputData = equaliser.stagingOutput(imgInput.size());
+		stagingTimer.stop();
+
+		// Run the intensity histogram, cumulative histogram, look-up table and back-projection on the device
+		ScopedTimer equaliseTimer(timers, "Equalise");
+		const EqualiserResult& result = equaliser.equalise(inputData, outputData, imgInput.width(), imgInput.height(), imgInput.spectrum(), options);
+		equaliseTimer.stop();
+		timers.recordEqualisation(result);
+
+		// Align the device clock with the host clock and add the device commands to the timeline
+		if (!traceFile.empty()) {
+			trace.syncDevice(equaliser.getQueue(), device.getInfo<CL_DEVICE_NAME>());
+			trace.addEqualisation(result, device.getInfo<CL_DEVICE_NAME>());
 		}
 
-		// Run the intensity histogram event on the device
-		cl::Event intHistoEvent;
-		queue.enqueueNDRangeKernel(intHistoKernel, cl::NullRange, cl::NDRange(imgInput.size()), cl::NullRange, NULL, &intHistoEvent);
-		
-		// Read the intensity histogram data from the device back to the host
-		queue.enqueueReadBuffer(intHistoBuffer, CL_TRUE, 0, histoSize, &IH[0]);
-
 		/*
-		STEP 6 ---------------- CUMULATIVE HISTOGRAM ----------------
+		STEP 6 ---------------- MODEL OUTPUT AND PERFORMANCE ----------------
 		*/
 
-		// Create a vector for the cumulative histogram with the size of the user-defined bin count
-		std::vector<int> CH(binCount);
-
-		// Fill the cumulative histogram buffer with zeros
-		queue.enqueueFillBuffer(cumHistoBuffer, 0, 0, histoSize);
-
-		// Prepare the kernel for the cumulative histogram	
-		cl::Kernel cumHistoKernel = cl::Kernel(program, cumHistoFunction.c_str());
-
-		// Switch the kernel according to choice.
-		switch (cumHistoChoice) {
-		case 1:
-		case 2:
-		case 3:
-			// Set the arguments for the cumulative histogram
-			cumHistoKernel.setArg(0, intHistoBuffer);
-			cumHistoKernel.setArg(1, cumHistoBuffer);
-			break;
-		case 4:
-			// Set the arguments for the cumulative histogram
-			cumHistoKernel.setArg(0, intHistoBuffer);
-			cumHistoKernel.setArg(1, cumHistoBuffer);
-			cumHistoKernel.setArg(2, cl::Local(histoSize));
-			cumHistoKernel.setArg(3, cl::Local(histoSize));
-			break;
+		stepTimer5.stop();
+		ScopedTimer stepTimer6(timers, "Model Output and Performance");
+
+		// Print the profiling values
+		if (!result.colourToFunction.empty()) {
+			printProfiling("Colour Conversion", result.colourToFunction, result.colourToEvent);
 		}
 
-		// Run the cumulative histogram event on the device
-		cl::Event cumHistoEvent;
-		queue.enqueueNDRangeKernel(cumHistoKernel, cl::NullRange, cl::NDRange(IH.size()), workGroup, NULL, &cumHistoEvent);
+		printProfiling("Intensity Histogram", result.intHistoFunction, result.intHistoEvent, result.IH);
 
-		// Read the cumulative histogram data from the device back to the host
-		queue.enqueueReadBuffer(cumHistoBuffer, CL_TRUE, 0, histoSize, &CH[0]);
+		printProfiling("Cumulative Histogram", result.cumHistoFunction, result.cumHistoEvent, result.CH);
 
-		/*
-		STEP 7 ---------------- LOOK-UP TABLE ----------------
-		*/
+		printProfiling("Look-up Table", result.lookupFunction, result.lookupEvent, result.LUT);
 
-		// Create a vector for the look-up-table with the size of the user-defined bin count
-		std::vector<int> LUT(binCount);
-
-		// Fill the look-up table buffer with zeros
-		queue.enqueueFillBuffer(lookupBuffer, 0, 0, histoSize);
-
-		// Prepare the kernel for the look-up table
-		cl::Kernel lookupKernel = cl::Kernel(program, lookupFunction.c_str());
-
-		// Switch the kernel according to choice.
-		switch (lookupChoice) {
-		case 1:
-			// Set the arguments for the look-up table
-			lookupKernel.setArg(0, cumHistoBuffer);
-			lookupKernel.setArg(1, lookupBuffer);
-			lookupKernel.setArg(2, maxIntensity);
-			break;
-		case 2:
-		case 3:
-			// Set the arguments for the look-up table
-			lookupKernel.setArg(0, cumHistoBuffer);
-			lookupKernel.setArg(1, lookupBuffer);
-			lookupKernel.setArg(2, maxIntensity);
-			lookupKernel.setArg(3, binCount);
-			break;
-		}
+		printProfiling("Back-Projection", result.backprojectFunction, result.backprojectEvent);
 
-		// Run the look-up table event
-		cl::Event lookupEvent;
-		queue.enqueueNDRangeKernel(lookupKernel, cl::NullRange, cl::NDRange(IH.size()), cl::NullRange, NULL, &lookupEvent);
+		if (!result.colourFromFunction.empty()) {
+			printProfiling("Colour Reversion", result.colourFromFunction, result.colourFromEvent);
+		}
 
-		// Read the look-up table data from the device back to the host
-		queue.enqueueReadBuffer(lookupBuffer, CL_TRUE, 0, histoSize, &LUT[0]);
+		// The kernel execution spans from the first to the last kernel, including the colour conversions when they are used
+		const cl::Event& firstEvent = result.colourToFunction.empty() ? result.intHistoEvent : result.colourToEvent;
+		const cl::Event& lastEvent = result.colourFromFunction.empty() ? result.backprojectEvent : result.colourFromEvent;
 
-		/*
-		STEP 8 ---------------- BACK-PROJECTION ----------------
-		*/
+		// Calculate and print the total execution time of the kernels
+		std::cout << std::endl << "Total Kernel Execution Time [ns]: " << lastEvent.getProfilingInfo<CL_PROFILING_COMMAND_END>() - firstEvent.getProfilingInfo<CL_PROFILING_COMMAND_START>() << std::endl;
 
-		// Prepare the kernel for the back-projection
-		cl::Kernel backprojectKernel = cl::Kernel(program, backprojectFunction.c_str());
-
-		// Switch the kernel according to choice.
-		switch (backprojectChoice) {
-		case 1:
-			// Set the arguments for the back-projection
-			backprojectKernel.setArg(0, imgInputBuffer);
-			backprojectKernel.setArg(1, lookupBuffer);
-			backprojectKernel.setArg(2, imgOutputBuffer);
-			break;
-		case 2:
-		case 3:
-			// Set the arguments for the back-projection
-			backprojectKernel.setArg(0, imgInputBuffer);
-			backprojectKernel.setArg(1, lookupBuffer);
-			backprojectKernel.setArg(2, imgOutputBuffer);
-			backprojectKernel.setArg(3, binCount);
-			backprojectKernel.setArg(4, histoSizeBuffer);
-			break;
+		// Record the kernels and transfers of the equalisation for the timing report and the efficiency report
+		MetricsRecorder metrics;
+		if (!metricsFile.empty() || rooflineReport) {
+			metrics.recordEqualisation(result, device.getInfo<CL_DEVICE_NAME>(), imgInput.width(), imgInput.height(), imgInput.spectrum(), options);
 		}
 
-		// Run the back-projection event
-		cl::Event backprojectEvent;
+		// Calibrate the device after the equalisation, so that the microkernels do not disturb its timings, and compare each kernel with the ceilings
+		if (rooflineReport) {
+			ScopedTimer calibrationTimer(timers, "Device Calibration");
+			RooflineReport roofline(equaliser);
+			std::cout << std::endl << "Roofline Report:" << std::endl;
+			roofline.print(std::cout, metrics.getMetrics());
+		}
 
-		/*
-		STEP 9 ---------------- MODEL OUTPUT AND PERFORMANCE ----------------
-		*/
+		// Serve copies of the image through the worker pool, to measure the latency and throughput under concurrent load
+		if (serverWorkers > 0) {
+			ScopedTimer serverTimer(timers, "Server Requests");
+			EqualiserServer server(platformID, deviceID, serverWorkers);
+
+			// Submit several requests per worker, each with its own output
+			int requestCount = serverWorkers * 4;
+			vector<vector<unsigned short>> serverOutputs(requestCount, vector<unsigned short>(imgInput.size()));
+			vector<future<EqualiseResponse>> responses;
+			for (int i = 0; i < requestCount; i++) {
+				responses.push_back(server.submit({ imgInput.data(), serverOutputs[i].data(), imgInput.width(), imgInput.height(), imgInput.spectrum(), options }));
+			}
 
-		// Create a vector for the output image data with the size of the input image
-		vector<unsigned short> outputData(imgInput.size());
-		queue.enqueueNDRangeKernel(backprojectKernel, cl::NullRange, cl::NDRange(imgInput.size()), cl::NullRange, NULL, &backprojectEvent);
+			// Wait for every request, rethrowing any error from the workers
+			for (future<EqualiseResponse>& response : responses) {
+				response.get();
+			}
 
-		// Read the output image data from the device back to the host
-		queue.enqueueReadBuffer(imgOutputBuffer, CL_TRUE, 0, imgInput.size() * sizeof(imgInput[0]), &outputData.data()[0]);
+			std::cout << std::endl << "Server Statistics:" << std::endl;
+			server.printStatistics(std::cout);
+		}
 
-		// Print the profiling values
-		printProfiling("Intensity Histogram", intHistoFunction, intHistoEvent, IH);
+		// Split batches of copies of the image across every device on the host, or across the NUMA nodes of the selected device
+		if (batchSize > 0) {
+			ScopedTimer batchTimer(timers, "Multi-Device Batches");
+			MultiDeviceScheduler scheduler(numaFission ? MultiDeviceScheduler::numaSubDevices(device) : MultiDeviceScheduler::allDevices());
 
-		printProfiling("Cumulative Histogram", cumHistoFunction, cumHistoEvent, CH);
+			vector<vector<unsigned short>> batchOutputs(batchSize, vector<unsigned short>(imgInput.size()));
+			vector<EqualiseRequest> requests;
+			for (int i = 0; i < batchSize; i++) {
+				requests.push_back({ imgInput.data(), batchOutputs[i].data(), imgInput.width(), imgInput.height(), imgInput.spectrum(), options });
+			}
 
-		printProfiling("Look-up Table", lookupFunction, lookupEvent, LUT);
+			// Add every image of the batches to the timing report, and aggregate their host times
+			if (!metricsFile.empty()) {
+				scheduler.setMetrics(&metrics);
+			}
+			scheduler.setTimers(&timers);
 
-		printProfiling("Back-Projection", backprojectFunction, backprojectEvent);
+			// Run the batch twice, as the first run measures the throughput that shares out the second
+			scheduler.equaliseBatch(requests);
+			scheduler.equaliseBatch(requests);
 
-		// Calculate and print the total execution time of the kernels
-		std::cout << std::endl << "Total Kernel Execution Time [ns]: " << backprojectEvent.getProfilingInfo<CL_PROFILING_COMMAND_END>() - intHistoEvent.getProfilingInfo<CL_PROFILING_COMMAND_START>() << std::endl;
-
-		CImg<modularImage> imgOutput(outputData.data(), imgInput.width(), imgInput.height(), imgInput.depth(), imgInput.spectrum());
-
-		// Check if the image used RGB 
-		if (rgbUsed == true) {
-			// Create a new image with the same width and height as the initial input image, with three colour channels
-			CImg<unsigned short> outputYCbCr = imgOutput.get_resize(imgInput.width(), imgInput.height(), 1, 3);
-
-			// Loop through each pixel in the image
-			for (int x = 0; x < outputYCbCr.width(); x++) {
-				for (int y = 0; y < outputYCbCr.height(); y++) {
-					// Set the first channel of the image to the equalised values
-					outputYCbCr(x, y, 0) = imgOutput(x, y);
-					// Set the second channel of the new image to the chroma blue channel values of the initial input image
-					outputYCbCr(x, y, 1) = cbChannel(x, y);
-					// Set the third channel of the new image to the chroma red channel values of the initial input image
-					outputYCbCr(x, y, 2) = crChannel(x, y);
-				}
+			// Every device must produce the same image as the single-device run
+			int mismatches = 0;
+			for (vector<unsigned short>& batchOutput : batchOutputs) {
+				mismatches += equal(batchOutput.begin(), batchOutput.end(), outputData) ? 0 : 1;
 			}
 
-			// Convert the image back into RGB
-			imgOutput = outputYCbCr.get_YCbCrtoRGB();
+			std::cout << std::endl << "Multi-Device Statistics" << (numaFission ? " (NUMA sub-devices)" : "") << ":" << std::endl;
+			scheduler.printStatistics(std::cout);
+			std::cout << "Images differing from the single-device output: " << mismatches << std::endl;
+		}
+
+		// Split the rows of the image across the devices, which must give the same image as the single-device run
+		if (splitImage) {
+			ScopedTimer splitTimer(timers, "Split Image");
+			MultiDeviceScheduler splitScheduler(numaFission ? MultiDeviceScheduler::numaSubDevices(device) : MultiDeviceScheduler::allDevices());
+
+			vector<unsigned short> splitOutput(imgInput.size());
+			splitScheduler.equaliseSplit(imgInput.data(), splitOutput.data(), imgInput.width(), imgInput.height(), imgInput.spectrum(), options);
+
+			std::cout << std::endl << "Split-Image Statistics:" << std::endl;
+			splitScheduler.printStatistics(std::cout);
+			std::cout << "Split-image output " << (equal(splitOutput.begin(), splitOutput.end(), outputData) ? "matches" : "differs from") << " the single-device output" << std::endl;
+		}
+
+		// Write the timing report of every recorded equalisation
+		if (!metricsFile.empty()) {
+			if (metrics.write(metricsFile)) {
+				std::cout << std::endl << "Timings of " << metrics.size() << " commands written to " << metricsFile << std::endl;
+			}
+			else {
+				std::cerr << "ERROR: cannot write " << metricsFile << std::endl;
+			}
 		}
 
+		CImg<modularImage> imgOutput(outputData, imgInput.width(), imgInput.height(), imgInput.depth(), imgInput.spectrum());
+
 		// Display the final equalised image
+		ScopedTimer displayOutputTimer(timers, "Display Output");
 		CImgDisplay displayOutput = displayImage(imgOutput, is16BitUsed, "Output");
+		displayOutputTimer.stop();
+		stepTimer6.stop();
+
+		// Print the host time of every step, which accounts for the time from the start of the program to the display of the output
+		std::cout << std::endl << "Host Step Timings:" << std::endl;
+		timers.print(std::cout);
+
+		// Write the timeline of everything up to the display of the output
+		if (!traceFile.empty()) {
+			if (trace.write(traceFile)) {
+				std::cout << std::endl << "Timeline written to " << traceFile << std::endl;
+			}
+			else {
+				std::cerr << "ERROR: cannot write " << traceFile << std::endl;
+			}
+		}
 
 		// Close the input image and output image windows if the ESC key is pressed
 		while (!displayInput.is_closed() && !displayOutput.is_closed()
@@ -0,0 +1,185 @@
+#include "include/EqualiserServer.h"
+
+void LatencyHistogram::record(cl_ulong latency) {
+	// Find the power-of-two bucket of the latency, so that bucket i holds latencies below 2^i nanoseconds
+	int bucket = 0;
+	while (bucket < 63 && ((cl_ulong)1 << bucket) <= latency)
+		bucket++;
+
+	buckets[bucket]++;
+	count++;
+}
+
+cl_ulong LatencyHistogram::percentile(double fraction) const {
+	// Walk the buckets until the requested share of the latencies has been passed
+	cl_ulong target = (cl_ulong)(fraction * count);
+	cl_ulong seen = 0;
+	for (int i = 0; i < 64; i++) {
+		seen += buckets[i];
+		if (seen > target)
+			return (cl_ulong)1 << i;
+	}
+	return 0;
+}
+
+void LatencyHistogram::print(ostream& out) const {
+	for (int i = 0; i < 64; i++) {
+		if (buckets[i] > 0) {
+			out << "  < " << ((cl_ulong)1 << i) << " [ns]: " << buckets[i] << endl;
+		}
+	}
+}
+
+EqualiserServer::EqualiserServer(int platformID, int deviceID, int workerCount, size_t queueCapacity, const string& kernelFile)
+	: queueCapacity(queueCapacity) {
+	// Build the program once for the shared context
+	context = GetContext(platformID, deviceID);
+	program = HistogramEqualiser::buildProgram(context, kernelFile);
+	cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+
+	// Give each worker its own equaliser, so that command queues, kernel arguments and buffers are never shared between threads
+	// The workers share one buffer pool and one pinned host pool, so that memory released by one worker can serve the next image of another
+	pool = make_shared<BufferPool>(context);
+	hostPool = make_shared<PinnedHostPool>(context);
+	for (int i = 0; i < workerCount; i++) {
+		equalisers.emplace_back(new HistogramEqualiser(context, program, device, pool, hostPool));
+	}
+
+	for (int i = 0; i < workerCount; i++) {
+		workers.emplace_back(&EqualiserServer::work, this, i);
+	}
+}
+
+EqualiserServer::~EqualiserServer() {
+	{
+		lock_guard<mutex> lock(queueMutex);
+		stopping = true;
+	}
+	notEmpty.notify_all();
+	notFull.notify_all();
+
+	for (thread& worker : workers) {
+		worker.join();
+	}
+}
+
+future<EqualiseResponse> EqualiserServer::push(const EqualiseRequest& request) {
+	// Start the throughput clock at the first request
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	{
+		lock_guard<mutex> lock(statisticsMutex);
+		if (!started) {
+			started = true;
+			firstSubmitted = now;
+		}
+	}
+
+	jobs.push_back(Job{ request, promise<EqualiseResponse>(), now });
+	future<EqualiseResponse> response = jobs.back().response.get_future();
+	notEmpty.notify_one();
+	return response;
+}
+
+future<EqualiseResponse> EqualiserServer::submit(const EqualiseRequest& request) {
+	unique_lock<mutex> lock(queueMutex);
+
+	// Apply backpressure by waiting for a worker to take a request when the queue is full
+	notFull.wait(lock, [this] { return jobs.size() < queueCapacity || stopping; });
+	if (stopping) {
+		throw runtime_error("EqualiserServer is stopping");
+	}
+
+	return push(request);
+}
+
+bool EqualiserServer::trySubmit(const EqualiseRequest& request, future<EqualiseResponse>& response) {
+	lock_guard<mutex> lock(queueMutex);
+	if (stopping || jobs.size() >= queueCapacity) {
+		return false;
+	}
+
+	response = push(request);
+	return true;
+}
+
+void EqualiserServer::work(int worker) {
+	HistogramEqualiser& equaliser = *equalisers[worker];
+
+	while (true) {
+		// Wait for a request, leaving once the queue has been drained after the server stops
+		Job job;
+		{
+			unique_lock<mutex> lock(queueMutex);
+			notEmpty.wait(lock, [this] { return !jobs.empty() || stopping; });
+			if (jobs.empty()) {
+				return;
+			}
+			job = move(jobs.front());
+			jobs.pop_front();
+		}
+		notFull.notify_one();
+
+		chrono::steady_clock::time_point started = chrono::steady_clock::now();
+
+		// Equalise the image on the queue of this worker, passing any OpenCL error back to the caller
+		try {
+			const EqualiseRequest& request = job.request;
+			equaliser.equalise(request.in, request.out, request.width, request.height, request.channels, request.options);
+		}
+		catch (...) {
+			{
+				lock_guard<mutex> lock(statisticsMutex);
+				requestsFailed++;
+			}
+			job.response.set_exception(current_exception());
+			continue;
+		}
+
+		chrono::steady_clock::time_point finished = chrono::steady_clock::now();
+
+		EqualiseResponse response;
+		response.worker = worker;
+		response.queuedTime = chrono::duration_cast<chrono::nanoseconds>(started - job.submitted).count();
+		response.serviceTime = chrono::duration_cast<chrono::nanoseconds>(finished - started).count();
+
+		{
+			lock_guard<mutex> lock(statisticsMutex);
+			queuedLatency.record(response.queuedTime);
+			serviceLatency.record(response.serviceTime);
+			totalLatency.record(response.queuedTime + response.serviceTime);
+			pixelsServed += (cl_ulong)job.request.width * job.request.height;
+			lastCompleted = finished;
+		}
+
+		job.response.set_value(response);
+	}
+}
+
+void EqualiserServer::printStatistics(ostream& out) {
+	lock_guard<mutex> lock(statisticsMutex);
+
+	cl_ulong completed = totalLatency.getCount();
+	double seconds = completed > 0 ? chrono::duration<double>(lastCompleted - firstSubmitted).count() : 0.0;
+
+	out << "Workers: " << workers.size() << ", queue capacity: " << queueCapacity << endl;
+	out << "Requests completed: " << completed << ", failed: " << requestsFailed << endl;
+
+	if (seconds > 0.0) {
+		out << "Throughput: " << completed / seconds << " requests/s, " << pixelsServed / seconds << " pixels/s" << endl;
+	}
+
+	BufferPoolStatistics buffers = pool->getStatistics();
+	out << "Buffer pool: " << buffers.allocations << " buffers allocated (" << buffers.allocatedBytes << " bytes), hit rate " << buffers.hitRate() * 100.0 << "% of " << buffers.requests << " requests" << endl;
+
+	BufferPoolStatistics pinned = hostPool->getStatistics();
+	out << "Pinned host pool: " << pinned.allocations << " buffers allocated (" << pinned.allocatedBytes << " bytes), hit rate " << pinned.hitRate() * 100.0 << "% of " << pinned.requests << " requests" << endl;
+
+	out << "Latency p50/p90/p99 [ns]: < " << totalLatency.percentile(0.5) << " / < " << totalLatency.percentile(0.9) << " / < " << totalLatency.percentile(0.99) << endl;
+
+	out << "Queued latency:" << endl;
+	queuedLatency.print(out);
+	out << "Service latency:" << endl;
+	serviceLatency.print(out);
+	out << "Total latency:" << endl;
+	totalLatency.print(out);
+}
@@ -0,0 +1,1016 @@
+#include <cstring>
+#include "include/HistogramEqualiser.h"
+
+#ifdef HISTEQ_EMBEDDED_KERNELS
+#include "EmbeddedKernels.h"
+#endif
+#ifdef HISTEQ_EMBEDDED_IL
+#include "EmbeddedKernelIL.h"
+#endif
+#ifdef HISTEQ_EMBEDDED_BINARY
+#include "EmbeddedKernelBinary.h"
+#endif
+
+using namespace cimg_library;
+
+// The kernel of each menu choice, indexed from 1
+static const char* intHistoFunctions[] = { "", "intHistogram", "intHistogram2", "intHistogram3", "intHistogramRGB", "intHistogramImage", "intHistogram2D", "intHistogramPersistent" };
+static const char* cumHistoFunctions[] = { "", "cumHistogram", "cumHistogramB", "cumHistogramHS", "cumHistogramHS2", "cumHistogramLUT" };
+static const char* lookupFunctions[] = { "", "lookupTable", "lookupTable2", "lookupTable3", "lookupTable4" };
+static const char* backprojectFunctions[] = { "", "backprojection", "backprojection2", "backprojection3", "backprojectionRGB", "backprojectionImage", "backprojection2D", "backprojectionPersistent" };
+
+// The kernels converting RGB into the device colour space of a colour mode and back, which are empty for the colour modes converted on the host
+static pair<string, string> colourFunctions(const string& colourMode) {
+	if (colourMode == "hsv") {
+		return { "rgbToHSV", "hsvToRGB" };
+	}
+	if (colourMode == "hsl") {
+		return { "rgbToHSL", "hslToRGB" };
+	}
+	if (colourMode == "lab") {
+		return { "rgbToLab", "labToRGB" };
+	}
+	return { "", "" };
+}
+
+bool HistogramEqualiser::supportsIntensityImages(const cl::Context& context, const cl::Device& device) {
+	if (!device.getInfo<CL_DEVICE_IMAGE_SUPPORT>()) {
+		return false;
+	}
+
+	// Single-channel formats are optional in OpenCL 1.2, so the format must be listed for reading and for writing
+	for (cl_mem_flags flags : { CL_MEM_READ_ONLY, CL_MEM_WRITE_ONLY }) {
+		vector<cl::ImageFormat> formats;
+		context.getSupportedImageFormats(flags, CL_MEM_OBJECT_IMAGE2D, &formats);
+		bool supported = false;
+		for (const cl::ImageFormat& format : formats) {
+			supported = supported || (format.image_channel_order == CL_R && format.image_channel_data_type == CL_UNSIGNED_INT16);
+		}
+		if (!supported) {
+			return false;
+		}
+	}
+	return true;
+}
+
+#if defined(HISTEQ_EMBEDDED_BINARY) || defined(HISTEQ_EMBEDDED_IL)
+// The signature of clCreateProgramWithILKHR from the cl_khr_il_program extension, which the OpenCL 1.2 headers do not declare
+typedef cl_program (CL_API_CALL* CreateProgramWithIL)(cl_context, const void*, size_t, cl_int*);
+
+// Build the kernels that were compiled during the build, the device binary first and then SPIR-V
+// Returns false when the devices reject both, so that the source is built instead
+static bool buildPrecompiled(const cl::Context& context, cl::Program& program) {
+	vector<cl::Device> devices = context.getInfo<CL_CONTEXT_DEVICES>();
+
+#ifdef HISTEQ_EMBEDDED_BINARY
+	// A binary for another device or driver is rejected when the program is created or built
+	try {
+		cl::Program::Binaries binaries(devices.size(), vector<unsigned char>(embeddedKernelBinary, embeddedKernelBinary + embeddedKernelBinarySize));
+		program = cl::Program(context, devices, binaries);
+		program.build(devices);
+		return true;
+	}
+	catch (const cl::Error&) {
+	}
+#endif
+
+#ifdef HISTEQ_EMBEDDED_IL
+	// Every device of the context must accept SPIR-V
+	bool ilSupported = true;
+	for (const cl::Device& device : devices) {
+		ilSupported = ilSupported && device.getInfo<CL_DEVICE_EXTENSIONS>().find("cl_khr_il_program") != string::npos;
+	}
+
+	if (ilSupported) {
+		cl_platform_id platform = devices[0].getInfo<CL_DEVICE_PLATFORM>();
+		CreateProgramWithIL createProgramWithIL = (CreateProgramWithIL)clGetExtensionFunctionAddressForPlatform(platform, "clCreateProgramWithILKHR");
+		cl_int error = CL_INVALID_OPERATION;
+		cl_program handle = createProgramWithIL ? createProgramWithIL(context(), embeddedKernelIL, embeddedKernelILSize, &error) : NULL;
+		if (handle != NULL && error == CL_SUCCESS) {
+			try {
+				// The program takes ownership of the handle
+				program = cl::Program(handle);
+				program.build(devices);
+				return true;
+			}
+			catch (const cl::Error&) {
+			}
+		}
+	}
+#endif
+
+	return false;
+}
+#endif
+
+HistogramEqualiser::HistogramEqualiser(int platformID, int deviceID, const string& kernelFile) : kernelFile(kernelFile) {
+	// Create an OpenCL context object, with the platform and device to be used
+	context = GetContext(platformID, deviceID);
+	device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+
+	// Build the kernel file for the device
+	program = buildProgram(context, kernelFile);
+
+	// Enable profiling for the command, to measure the program performance
+	queue = cl::CommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE);
+
+	// The double-precision look-up tables are only compiled on devices with fp64 support, and the image kernels on devices with image support
+	doublePrecision = device.getInfo<CL_DEVICE_EXTENSIONS>().find("cl_khr_fp64") != string::npos;
+	imageSupport = supportsIntensityImages(context, device);
+
+	pool = make_shared<BufferPool>(context);
+	hostPool = make_shared<PinnedHostPool>(context);
+}
+
+HistogramEqualiser::HistogramEqualiser(const cl::Context& context, const cl::Program& program, const cl::Device& device, shared_ptr<BufferPool> pool, shared_ptr<PinnedHostPool> hostPool)
+	: context(context), program(program), device(device), kernelFile("kernels/my_kernels.cl"), pool(pool), hostPool(hostPool) {
+	// Use pools of its own when none are shared
+	if (!this->pool) {
+		this->pool = make_shared<BufferPool>(context);
+	}
+	if (!this->hostPool) {
+		this->hostPool = make_shared<PinnedHostPool>(context);
+	}
+
+	// Enable profiling for the command, to measure the program performance
+	queue = cl::CommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE);
+
+	// The double-precision look-up tables are only compiled on devices with fp64 support, and the image kernels on devices with image support
+	doublePrecision = device.getInfo<CL_DEVICE_EXTENSIONS>().find("cl_khr_fp64") != string::npos;
+	imageSupport = supportsIntensityImages(context, device);
+}
+
+cl::Program HistogramEqualiser::buildProgram(const cl::Context& context, const string& kernelFile, const string& buildOptions) {
+#if defined(HISTEQ_EMBEDDED_BINARY) || defined(HISTEQ_EMBEDDED_IL)
+	// Skip compiling the default kernel file when the devices accept the kernels compiled during the build, which were built without options
+	cl::Program precompiled;
+	if (kernelFile == "kernels/my_kernels.cl" && buildOptions.empty() && buildPrecompiled(context, precompiled)) {
+		return precompiled;
+	}
+#endif
+
+	// Set up the sources for the OpenCL program and add the kernel file, which contains the necessary functions
+	cl::Program::Sources sources;
+#ifdef HISTEQ_EMBEDDED_KERNELS
+	// The CMake build compiles the default kernel file into the binary, so it does not depend on the working directory
+	if (kernelFile == "kernels/my_kernels.cl") {
+		sources.push_back(string((const char*)embeddedKernelSource, embeddedKernelSourceSize));
+	}
+	else {
+		AddSources(sources, kernelFile);
+	}
+#else
+	AddSources(sources, kernelFile);
+#endif
+
+	// Create the OpenCL program from the sources
+	cl::Program program(context, sources);
+
+	// Try to build the OpenCL program
+	try {
+		program.build(buildOptions.c_str());
+	}
+
+	// If there are errors building the program, output the status, options, and log to the console, and throw the error
+	catch (const cl::Error& err) {
+		cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+		std::cout << "Build Status: " << program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(device) << std::endl;
+		std::cout << "Build Options:\t" << program.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(device) << std::endl;
+		std::cout << "Build Log:\t " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << std::endl;
+		throw err;
+	}
+
+	return program;
+}
+
+string HistogramEqualiser::specialisationOptions(int binCount, int maxIntensity) {
+	int increments = (maxIntensity + 1) / binCount;
+	string buildOptions = "-D BIN_COUNT=" + to_string(binCount) + " -D MAX_INTENSITY=" + to_string(maxIntensity) + " -D INCREMENTS=" + to_string(increments);
+
+	// A power-of-two bin width turns the division that finds the bin of a value into a shift
+	if ((increments & (increments - 1)) == 0) {
+		int shift = 0;
+		while ((1 << shift) < increments) {
+			shift++;
+		}
+		buildOptions += " -D SHIFT=" + to_string(shift);
+	}
+
+	return buildOptions;
+}
+
+cl::NDRange HistogramEqualiser::launchTile(const cl::Device& device, int tileWidth, int tileHeight) {
+	// Keep the full width of the rows where possible, as neighbouring items of a row read neighbouring pixels
+	size_t maxSize = device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
+	vector<size_t> maxItems = device.getInfo<CL_DEVICE_MAX_WORK_ITEM_SIZES>();
+	size_t width = max((size_t)1, min({ (size_t)max(tileWidth, 1), maxItems[0], maxSize }));
+	size_t height = max((size_t)1, min({ (size_t)max(tileHeight, 1), maxItems[1], maxSize / width }));
+	return cl::NDRange(width, height);
+}
+
+cl::NDRange HistogramEqualiser::persistentGroup(const cl::Device& device) {
+	// Work groups of up to 256 items, as for the per-channel histogram
+	return cl::NDRange(min((size_t)256, device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>()));
+}
+
+cl::NDRange HistogramEqualiser::persistentRange(const cl::Device& device, int groupsPerComputeUnit, size_t values) {
+	// Enough work groups to keep every compute unit busy, but no more than the values fill, so that small images do not launch idle groups
+	size_t groupSize = persistentGroup(device)[0];
+	size_t groups = (size_t)device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>() * max(groupsPerComputeUnit, 1);
+	groups = max((size_t)1, min(groups, (values + groupSize - 1) / groupSize));
+	return cl::NDRange(groups * groupSize);
+}
+
+cl::NDRange HistogramEqualiser::tiledRange(int width, int height, const cl::NDRange& tile, int itemsPerThread) {
+	// Each tile covers a run of items per thread times its width in pixels, so the columns are counted in those runs
+	size_t tileColumns = tile[0] * max(itemsPerThread, 1);
+	return cl::NDRange(((width + tileColumns - 1) / tileColumns) * tile[0], ((height + tile[1] - 1) / tile[1]) * tile[1]);
+}
+
+int HistogramEqualiser::selectHistogram(const EqualiserOptions& options) const {
+	// The standardised histogram indexes the bins by intensity, so it needs a bin for every intensity level and otherwise uses the variable implementation
+	if (options.intHistoChoice == 1 && options.binCount != options.maxIntensity + 1) {
+		return 2;
+	}
+	return options.intHistoChoice;
+}
+
+int HistogramEqualiser::selectScan(const EqualiserOptions& options) const {
+	// Histogram matching cross-multiplies by the last cumulative value as the pixel count, which the exclusive serial and Blelloch scans do not hold, so it uses the double buffered Hillis-Steele scan instead
+	if (!options.targetCDF.empty() && (options.cumHistoChoice == 1 || options.cumHistoChoice == 2)) {
+		return 4;
+	}
+
+	// The Blelloch scan halves the bins at every level, so it needs a power of two and otherwise uses the serial scan, which is also exclusive
+	if (options.cumHistoChoice == 2 && (options.binCount & (options.binCount - 1)) != 0) {
+		return 1;
+	}
+	return options.cumHistoChoice;
+}
+
+int HistogramEqualiser::selectBackprojection(const EqualiserOptions& options) const {
+	// The standardised back-projection indexes the look-up table by intensity, so it needs a bin for every intensity level and otherwise uses the variable implementation
+	if (options.backprojectChoice == 1 && options.binCount != options.maxIntensity + 1) {
+		return 2;
+	}
+	return options.backprojectChoice;
+}
+
+int HistogramEqualiser::selectLookup(const EqualiserOptions& options) const {
+	int lookupChoice = options.lookupChoice;
+
+	// The standardised look-up table indexes the cumulative histogram by intensity, so it needs a bin for every intensity level and otherwise uses the variable implementation
+	if (lookupChoice == 1 && options.binCount != options.maxIntensity + 1) {
+		lookupChoice = 2;
+	}
+
+	// The double-precision look-up tables are not compiled on devices without fp64 support, so fall back to the fixed-point implementation
+	if (lookupChoice >= 1 && lookupChoice <= 3 && !doublePrecision) {
+		lookupChoice = 4;
+	}
+	return lookupChoice;
+}
+
+void HistogramEqualiser::useProgram(const EqualiserOptions& options) {
+	programOptions = options.specialise ? specialisationOptions(options.binCount, options.maxIntensity) : "";
+
+	// Build the specialised program the first time its configuration is used, so that later calls with the same bin count and bit depth reuse it
+	if (!programOptions.empty() && specialisedPrograms.find(programOptions) == specialisedPrograms.end()) {
+		specialisedPrograms.emplace(programOptions, buildProgram(context, kernelFile, programOptions));
+	}
+}
+
+CachedKernel& HistogramEqualiser::getKernel(const string& name) {
+	const cl::Program& selected = programOptions.empty() ? program : specialisedPrograms.at(programOptions);
+	return kernels.get(selected, programOptions, name);
+}
+
+cl::Event* HistogramEqualiser::transfer(const string& stage, const string& command, size_t bytes, const void* host) {
+	result.transfers.push_back({ stage, command, bytes, isPinned(host, bytes), cl::Event() });
+	return &result.transfers.back().event;
+}
+
+bool HistogramEqualiser::isPinned(const void* host, size_t bytes) const {
+	const char* start = (const char*)host;
+	for (const PinnedBuffer* pinned : { &inputStaging, &outputStaging, &colourStaging }) {
+		const char* pinnedStart = (const char*)pinned->host;
+		if (host != NULL && pinnedStart != NULL && start >= pinnedStart && start + bytes <= pinnedStart + pinned->capacity) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void HistogramEqualiser::reserveImages(int width, int height) {
+	result.bufferRequests += 2;
+	if (width != imageWidth || height != imageHeight) {
+		cl::ImageFormat format(CL_R, CL_UNSIGNED_INT16);
+		imgInputImage = cl::Image2D(context, CL_MEM_READ_ONLY, format, width, height);
+		imgOutputImage = cl::Image2D(context, CL_MEM_WRITE_ONLY, format, width, height);
+		imageWidth = width;
+		imageHeight = height;
+		result.bufferAllocations += 2;
+		allocationCount += 2;
+	}
+}
+
+void HistogramEqualiser::writeIntensity(const uint16_t* plane, int width, int height, size_t values, bool imagePipeline) {
+	if (imagePipeline) {
+		queue.enqueueWriteImage(imgInputImage, CL_TRUE, { 0, 0, 0 }, { (size_t)width, (size_t)height, 1 }, 0, 0, plane, NULL, transfer("Input Image", "write", values * sizeof(uint16_t), plane));
+	}
+	else {
+		queue.enqueueWriteBuffer(imgInputBuffer, CL_TRUE, 0, values * sizeof(uint16_t), plane, NULL, transfer("Input Image", "write", values * sizeof(uint16_t), plane));
+	}
+}
+
+void HistogramEqualiser::readIntensity(uint16_t* plane, int width, int height, size_t values, bool imagePipeline) {
+	if (imagePipeline) {
+		queue.enqueueReadImage(imgOutputImage, CL_TRUE, { 0, 0, 0 }, { (size_t)width, (size_t)height, 1 }, 0, 0, plane, NULL, transfer("Output Image", "read", values * sizeof(uint16_t), plane));
+	}
+	else {
+		queue.enqueueReadBuffer(imgOutputBuffer, CL_TRUE, 0, values * sizeof(uint16_t), plane, NULL, transfer("Output Image", "read", values * sizeof(uint16_t), plane));
+	}
+}
+
+uint16_t* HistogramEqualiser::stagingInput(size_t values) {
+	hostPool->reserve(inputStaging, values * sizeof(uint16_t));
+	return (uint16_t*)inputStaging.host;
+}
+
+uint16_t* HistogramEqualiser::stagingOutput(size_t values) {
+	hostPool->reserve(outputStaging, values * sizeof(uint16_t));
+	return (uint16_t*)outputStaging.host;
+}
+
+void HistogramEqualiser::reserve(cl::Buffer& buffer, size_t& capacity, size_t size) {
+	result.bufferRequests++;
+	if (pool->reserve(buffer, capacity, size)) {
+		result.bufferAllocations++;
+		allocationCount++;
+	}
+}
+
+void HistogramEqualiser::reserveTarget(size_t size) {
+	size_t capacity = targetCDFCapacity;
+	reserve(targetCDFBuffer, targetCDFCapacity, size);
+	// A swapped buffer no longer holds the target that was written to it
+	if (targetCDFCapacity != capacity) {
+		deviceTarget.clear();
+	}
+}
+
+void HistogramEqualiser::fillBinValues(int binCount, int maxIntensity) {
+	// The bin values hold one bound past the last bin, which closes the last bin at the end of the intensity range
+	int increments = (maxIntensity + 1) / binCount;
+	binValues.resize(binCount + 1);
+	for (int i = 0; i < binCount; i++) {
+		binValues[i] = i * increments;
+	}
+	binValues[binCount] = maxIntensity + 1;
+}
+
+const EqualiserResult& HistogramEqualiser::equalise(const uint16_t* in, uint16_t* out, int width, int height, int channels, const EqualiserOptions& options) {
+	int binCount = options.binCount;
+	int maxIntensity = options.maxIntensity;
+
+	// Run the kernels from the program for the bin count and bit depth when they are specialised
+	useProgram(options);
+
+	// Histogram matching replaces the look-up table when a target cumulative histogram is given
+	bool histogramMatching = !options.targetCDF.empty();
+
+	// Start new lists of transfers and host steps, keeping their storage
+	result.transfers.clear();
+	result.hostSpans.clear();
+	result.bufferRequests = 0;
+	result.bufferAllocations = 0;
+
+	// The per-channel mode equalises the three RGB planes, while the device colour spaces and YCbCr equalise a single intensity channel
+	bool perChannel = (channels == 3) && options.colourMode == "rgb" && !histogramMatching;
+	bool deviceColour = (channels == 3) && (options.colourMode == "hsv" || options.colourMode == "hsl" || options.colourMode == "lab");
+	bool hostYCbCr = (channels == 3) && !perChannel && !deviceColour;
+
+	// The image pipeline reads a single intensity plane written from the host, on devices that support its images
+	bool imagePipeline = options.imagePipeline && imageSupport && !perChannel && !deviceColour;
+
+	// The tiled kernels read a single intensity plane from the input buffer, so they also follow the device colour conversions
+	bool tiledLaunch = options.tiledLaunch && !imagePipeline && !perChannel;
+
+	// The persistent kernels also read a single intensity plane from the input buffer
+	bool persistentLaunch = options.persistentLaunch && !tiledLaunch && !imagePipeline && !perChannel;
+
+	// The row tiles of the tiled and image kernels for the device
+	cl::NDRange tile = launchTile(device, options.tileWidth, options.tileHeight);
+	int itemsPerThread = max(options.itemsPerThread, 1);
+
+	// The per-channel mode builds the three histograms in one kernel, scans them in one batched launch of the fused look-up table, and back-projects all channels together
+	// The image pipeline, the tiled launch and the persistent launch replace the intensity histogram and back-projection with their own kernels
+	int intHistoChoice = perChannel ? 4 : imagePipeline ? 5 : tiledLaunch ? 6 : persistentLaunch ? 7 : selectHistogram(options);
+	int cumHistoChoice = perChannel ? 5 : selectScan(options);
+	int backprojectChoice = perChannel ? 4 : imagePipeline ? 5 : tiledLaunch ? 6 : persistentLaunch ? 7 : selectBackprojection(options);
+
+	// Fall back from the look-up tables that cannot run with these options or on this device
+	int lookupChoice = selectLookup(options);
+
+	// The fifth cumulative histogram writes the look-up table itself, so the look-up table stage is not launched
+	bool lookupFused = (cumHistoChoice == 5);
+
+	// Record the kernels used by each stage
+	result.colourToFunction = "";
+	result.colourFromFunction = "";
+	if (deviceColour) {
+		pair<string, string> functions = colourFunctions(options.colourMode);
+		result.colourToFunction = functions.first;
+		result.colourFromFunction = functions.second;
+	}
+	result.intHistoFunction = intHistoFunctions[intHistoChoice];
+	result.cumHistoFunction = cumHistoFunctions[cumHistoChoice];
+	result.lookupFunction = histogramMatching ? "histogramMatch" : lookupFused ? result.cumHistoFunction : lookupFunctions[lookupChoice];
+	result.backprojectFunction = backprojectFunctions[backprojectChoice];
+
+	/*
+	---------------- BUFFER PREPARATION ----------------
+	*/
+
+	// The per-channel mode stores one histogram per channel, one after another
+	int channelCount = perChannel ? 3 : 1;
+
+	// The number of pixels in each channel of the image, and the number of values that are equalised
+	int pixelCount = width * height;
+	size_t intensitySize = (size_t)channelCount * pixelCount;
+
+	// Calculate the total size of the histogram in bytes
+	size_t histoSize = channelCount * binCount * sizeof(int);
+
+	// Determine the size of the increments for the histogram, based upon the bin count
+	int increments = (maxIntensity + 1) / binCount;
+	fillBinValues(binCount, maxIntensity);
+
+	// Grow the device buffers when the image or the histogram is larger than any before, where the image pipeline holds the intensity plane in images instead
+	if (imagePipeline) {
+		reserveImages(width, height);
+	}
+	else {
+		reserve(imgInputBuffer, imgInputCapacity, intensitySize * sizeof(uint16_t));
+		reserve(imgOutputBuffer, imgOutputCapacity, intensitySize * sizeof(uint16_t));
+	}
+	reserve(intHistoBuffer, intHistoCapacity, histoSize);
+	reserve(cumHistoBuffer, cumHistoCapacity, histoSize);
+	reserve(lookupBuffer, lookupCapacity, histoSize);
+	reserve(histoSizeBuffer, histoSizeCapacity, (binCount + 1) * sizeof(int));
+	if (deviceColour) {
+		reserve(colourBuffer, colourCapacity, 3 * (size_t)pixelCount * sizeof(uint16_t));
+		reserve(chromaBuffer, chromaCapacity, 2 * (size_t)pixelCount * sizeof(float));
+	}
+	if (histogramMatching) {
+		reserveTarget(binCount * sizeof(int));
+	}
+
+	result.IH.resize(channelCount * binCount);
+	result.CH.resize(channelCount * binCount);
+	result.LUT.resize(channelCount * binCount);
+
+	/*
+	---------------- IMAGE PREPARATION ----------------
+	*/
+
+	// Write the RGB image to the device and convert it, leaving the intensity channel in the input buffer
+	if (deviceColour) {
+		queue.enqueueWriteBuffer(colourBuffer, CL_TRUE, 0, 3 * (size_t)pixelCount * sizeof(uint16_t), in, NULL, transfer("Input Image", "write", 3 * (size_t)pixelCount * sizeof(uint16_t), in));
+
+		CachedKernel& colourToKernel = getKernel(result.colourToFunction);
+		colourToKernel.setArg(0, colourBuffer);
+		colourToKernel.setArg(1, imgInputBuffer);
+		colourToKernel.setArg(2, chromaBuffer);
+		colourToKernel.setArg(3, pixelCount);
+		colourToKernel.setArg(4, maxIntensity);
+		queue.enqueueNDRangeKernel(colourToKernel, cl::NullRange, cl::NDRange(pixelCount), cl::NullRange, NULL, &result.colourToEvent);
+	}
+
+	// Convert the RGB image to YCbCr on the host in pinned memory and write the luma channel, which is the first plane
+	else if (hostYCbCr) {
+		chrono::steady_clock::time_point converting = chrono::steady_clock::now();
+		hostPool->reserve(colourStaging, 3 * (size_t)pixelCount * sizeof(uint16_t));
+		imgYCbCr.assign((unsigned short*)colourStaging.host, width, height, 1, 3, true);
+		memcpy(imgYCbCr.data(), in, 3 * (size_t)pixelCount * sizeof(uint16_t));
+		imgYCbCr.RGBtoYCbCr();
+		result.hostSpans.push_back({ "RGB to YCbCr", converting, chrono::steady_clock::now() });
+		writeIntensity(imgYCbCr.data(), width, height, pixelCount, imagePipeline);
+	}
+
+	// Otherwise write the input image data to the relevant device buffer or image
+	else {
+		writeIntensity(in, width, height, intensitySize, imagePipeline);
+	}
+
+	/*
+	---------------- INTENSITY HISTOGRAM ----------------
+	*/
+
+	queue.enqueueWriteBuffer(histoSizeBuffer, CL_TRUE, 0, binValues.size() * sizeof(int), &binValues[0], NULL, transfer("Bin Values", "write", binValues.size() * sizeof(int)));
+
+	queue.enqueueFillBuffer(intHistoBuffer, 0, 0, histoSize, NULL, transfer("Intensity Histogram", "fill", histoSize));
+
+	// Prepare the kernel for the intensity histogram
+	CachedKernel& intHistoKernel = getKernel(result.intHistoFunction);
+
+	// Switch the kernel according to choice.
+	switch (intHistoChoice) {
+		case 1:
+			// Set the arguments for the intensity histogram
+			intHistoKernel.setArg(0, imgInputBuffer);
+			intHistoKernel.setArg(1, intHistoBuffer);
+			break;
+		case 2:
+			// Set the arguments for the intensity histogram
+			intHistoKernel.setArg(0, imgInputBuffer);
+			intHistoKernel.setArg(1, intHistoBuffer);
+			intHistoKernel.setArg(2, binCount);
+			intHistoKernel.setArg(3, increments);
+			break;
+		case 3:
+			// Set the arguments for the intensity histogram
+			intHistoKernel.setArg(0, imgInputBuffer);
+			intHistoKernel.setArg(1, intHistoBuffer);
+			intHistoKernel.setArg(2, (int)intensitySize);
+			intHistoKernel.setArg(3, binCount);
+			intHistoKernel.setArg(4, histoSizeBuffer);
+			intHistoKernel.setArg(5, cl::Local(histoSize));
+			break;
+		case 4:
+			// Set the arguments for the intensity histogram, with a local sub-histogram for each channel
+			intHistoKernel.setArg(0, imgInputBuffer);
+			intHistoKernel.setArg(1, intHistoBuffer);
+			intHistoKernel.setArg(2, pixelCount);
+			intHistoKernel.setArg(3, binCount);
+			intHistoKernel.setArg(4, increments);
+			intHistoKernel.setArg(5, cl::Local(histoSize));
+			break;
+		case 5:
+			// Set the arguments for the intensity histogram of the input image, with a local sub-histogram for each tile
+			intHistoKernel.setArg(0, imgInputImage);
+			intHistoKernel.setArg(1, intHistoBuffer);
+			intHistoKernel.setArg(2, binCount);
+			intHistoKernel.setArg(3, increments);
+			intHistoKernel.setArg(4, itemsPerThread);
+			intHistoKernel.setArg(5, cl::Local(histoSize));
+			break;
+		case 6:
+			// Set the arguments for the intensity histogram over row tiles, with a local sub-histogram for each tile
+			intHistoKernel.setArg(0, imgInputBuffer);
+			intHistoKernel.setArg(1, intHistoBuffer);
+			intHistoKernel.setArg(2, width);
+			intHistoKernel.setArg(3, height);
+			intHistoKernel.setArg(4, binCount);
+			intHistoKernel.setArg(5, increments);
+			intHistoKernel.setArg(6, itemsPerThread);
+			intHistoKernel.setArg(7, cl::Local(histoSize));
+			break;
+		case 7:
+			// Set the arguments for the persistent intensity histogram, with a local sub-histogram for each work group
+			intHistoKernel.setArg(0, imgInputBuffer);
+			intHistoKernel.setArg(1, intHistoBuffer);
+			intHistoKernel.setArg(2, (int)intensitySize);
+			intHistoKernel.setArg(3, binCount);
+			intHistoKernel.setArg(4, increments);
+			intHistoKernel.setArg(5, cl::Local(histoSize));
+			break;
+	}
+
+	// Launch one work item per value by default
+	cl::NDRange intHistoGlobal(intensitySize);
+	cl::NDRange intHistoLocal = cl::NullRange;
+
+	// The per-channel histogram uses one work item per pixel in full work groups, so the pixel count is rounded up to the work-group size
+	if (intHistoChoice == 4) {
+		size_t localSize = min((size_t)256, device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>());
+		intHistoGlobal = cl::NDRange(((pixelCount + localSize - 1) / localSize) * localSize);
+		intHistoLocal = cl::NDRange(localSize);
+	}
+
+	// The image and tiled histograms launch over row tiles, so each dimension is rounded up to whole tiles
+	if (intHistoChoice == 5 || intHistoChoice == 6) {
+		intHistoLocal = tile;
+		intHistoGlobal = tiledRange(width, height, tile, itemsPerThread);
+	}
+
+	// The persistent histogram launches a fixed number of work groups for the device, which stride over the image
+	if (intHistoChoice == 7) {
+		intHistoLocal = persistentGroup(device);
+		intHistoGlobal = persistentRange(device, options.groupsPerComputeUnit, intensitySize);
+	}
+
+	// Run the intensity histogram event on the device
+	queue.enqueueNDRangeKernel(intHistoKernel, cl::NullRange, intHistoGlobal, intHistoLocal, NULL, &result.intHistoEvent);
+
+	// Read the intensity histogram data from the device back to the host
+	queue.enqueueReadBuffer(intHistoBuffer, CL_TRUE, 0, histoSize, &result.IH[0], NULL, transfer("Intensity Histogram", "read", histoSize));
+
+	// Scan the intensity histogram and build the look-up table
+	lookupStages(options, cumHistoChoice, lookupChoice, channelCount);
+
+	// Back-project the intensity values through the look-up table
+	backprojectStage(backprojectChoice, binCount, increments, width, height, intensitySize, tile, itemsPerThread, options.groupsPerComputeUnit);
+
+	/*
+	---------------- IMAGE OUTPUT ----------------
+	*/
+
+	// Convert the equalised intensity channel back to RGB, reusing the buffer of the RGB image
+	if (deviceColour) {
+		CachedKernel& colourFromKernel = getKernel(result.colourFromFunction);
+		colourFromKernel.setArg(0, imgOutputBuffer);
+		colourFromKernel.setArg(1, chromaBuffer);
+		colourFromKernel.setArg(2, colourBuffer);
+		colourFromKernel.setArg(3, pixelCount);
+		colourFromKernel.setArg(4, maxIntensity);
+		queue.enqueueNDRangeKernel(colourFromKernel, cl::NullRange, cl::NDRange(pixelCount), cl::NullRange, NULL, &result.colourFromEvent);
+
+		queue.enqueueReadBuffer(colourBuffer, CL_TRUE, 0, 3 * (size_t)pixelCount * sizeof(uint16_t), out, NULL, transfer("Output Image", "read", 3 * (size_t)pixelCount * sizeof(uint16_t), out));
+	}
+
+	// Replace the luma channel with the equalised values and convert the image back into RGB
+	else if (hostYCbCr) {
+		readIntensity(imgYCbCr.data(), width, height, pixelCount, imagePipeline);
+		chrono::steady_clock::time_point converting = chrono::steady_clock::now();
+		imgYCbCr.YCbCrtoRGB();
+		memcpy(out, imgYCbCr.data(), 3 * (size_t)pixelCount * sizeof(uint16_t));
+		result.hostSpans.push_back({ "YCbCr to RGB", converting, chrono::steady_clock::now() });
+	}
+
+	// Otherwise read the output image data from the device buffer or image back to the host
+	else {
+		readIntensity(out, width, height, intensitySize, imagePipeline);
+	}
+
+	return result;
+}
+
+void HistogramEqualiser::lookupStages(const EqualiserOptions& options, int cumHistoChoice, int lookupChoice, int channelCount) {
+	int binCount = options.binCount;
+	int maxIntensity = options.maxIntensity;
+	int increments = (maxIntensity + 1) / binCount;
+	size_t histoSize = channelCount * binCount * sizeof(int);
+	bool histogramMatching = !options.targetCDF.empty();
+	bool lookupFused = (cumHistoChoice == 5);
+
+	/*
+	---------------- CUMULATIVE HISTOGRAM ----------------
+	*/
+
+	// Fill the cumulative histogram buffer with zeros
+	queue.enqueueFillBuffer(cumHistoBuffer, 0, 0, histoSize, NULL, transfer("Cumulative Histogram", "fill", histoSize));
+
+	// Prepare the kernel for the cumulative histogram
+	CachedKernel& cumHistoKernel = getKernel(result.cumHistoFunction);
+
+	// Switch the kernel according to choice.
+	switch (cumHistoChoice) {
+	case 1:
+	case 2:
+	case 3:
+		// Set the arguments for the cumulative histogram
+		cumHistoKernel.setArg(0, intHistoBuffer);
+		cumHistoKernel.setArg(1, cumHistoBuffer);
+		break;
+	case 4:
+		// Set the arguments for the cumulative histogram
+		cumHistoKernel.setArg(0, intHistoBuffer);
+		cumHistoKernel.setArg(1, cumHistoBuffer);
+		cumHistoKernel.setArg(2, cl::Local(histoSize));
+		cumHistoKernel.setArg(3, cl::Local(histoSize));
+		break;
+	case 5:
+		// Set the arguments for the cumulative histogram and the look-up table it writes
+		cumHistoKernel.setArg(0, intHistoBuffer);
+		cumHistoKernel.setArg(1, cumHistoBuffer);
+		cumHistoKernel.setArg(2, lookupBuffer);
+		cumHistoKernel.setArg(3, maxIntensity);
+		cumHistoKernel.setArg(4, cl::Local(binCount * sizeof(int)));
+		cumHistoKernel.setArg(5, cl::Local(binCount * sizeof(int)));
+		break;
+	}
+
+	// Run the cumulative histogram event on the device, with a work group for each histogram
+	queue.enqueueNDRangeKernel(cumHistoKernel, cl::NullRange, cl::NDRange(result.IH.size()), cl::NDRange(binCount), NULL, &result.cumHistoEvent);
+
+	// Read the cumulative histogram data from the device back to the host
+	queue.enqueueReadBuffer(cumHistoBuffer, CL_TRUE, 0, histoSize, &result.CH[0], NULL, transfer("Cumulative Histogram", "read", histoSize));
+
+	/*
+	---------------- LOOK-UP TABLE ----------------
+	*/
+
+	// Histogram matching inverts the target cumulative histogram in place of the normalised look-up table
+	if (histogramMatching) {
+		// The target is only written when it differs from the one already held on the device
+		if (options.targetCDF != deviceTarget) {
+			queue.enqueueWriteBuffer(targetCDFBuffer, CL_TRUE, 0, binCount * sizeof(int), &options.targetCDF[0], NULL, transfer("Target Histogram", "write", binCount * sizeof(int)));
+			deviceTarget = options.targetCDF;
+		}
+
+		// Set the arguments for the histogram matching
+		CachedKernel& lookupKernel = getKernel(result.lookupFunction);
+		lookupKernel.setArg(0, cumHistoBuffer);
+		lookupKernel.setArg(1, targetCDFBuffer);
+		lookupKernel.setArg(2, lookupBuffer);
+		lookupKernel.setArg(3, binCount);
+		lookupKernel.setArg(4, increments);
+		lookupKernel.setArg(5, maxIntensity);
+
+		// Run the histogram matching event
+		queue.enqueueNDRangeKernel(lookupKernel, cl::NullRange, cl::NDRange(result.IH.size()), cl::NullRange, NULL, &result.lookupEvent);
+	}
+
+	// The fused cumulative histogram has already written the look-up table, so its event is reused
+	else if (lookupFused) {
+		result.lookupEvent = result.cumHistoEvent;
+	}
+	else {
+		// Fill the look-up table buffer with zeros
+		queue.enqueueFillBuffer(lookupBuffer, 0, 0, histoSize, NULL, transfer("Look-up Table", "fill", histoSize));
+
+		// Prepare the kernel for the look-up table
+		CachedKernel& lookupKernel = getKernel(result.lookupFunction);
+
+		// Switch the kernel according to choice.
+		switch (lookupChoice) {
+		case 1:
+			// Set the arguments for the look-up table
+			lookupKernel.setArg(0, cumHistoBuffer);
+			lookupKernel.setArg(1, lookupBuffer);
+			lookupKernel.setArg(2, maxIntensity);
+			break;
+		case 2:
+		case 3:
+			// Set the arguments for the look-up table
+			lookupKernel.setArg(0, cumHistoBuffer);
+			lookupKernel.setArg(1, lookupBuffer);
+			lookupKernel.setArg(2, maxIntensity);
+			lookupKernel.setArg(3, binCount);
+			break;
+		case 4:
+			// Calculate the reciprocal of the last cumulative value once, so the kernel only needs a multiply and shifts
+			// Dividing by the last value rather than the pixel count gives the same table as the double-precision kernels after the exclusive scans
+			cl_ulong reciprocal;
+			int shift1, shift2;
+			GetFixedPointReciprocal((cl_uint)max(result.CH[binCount - 1], 1), reciprocal, shift1, shift2);
+
+			// Set the arguments for the look-up table
+			lookupKernel.setArg(0, cumHistoBuffer);
+			lookupKernel.setArg(1, lookupBuffer);
+			lookupKernel.setArg(2, maxIntensity);
+			lookupKernel.setArg(3, reciprocal);
+			lookupKernel.setArg(4, shift1);
+			lookupKernel.setArg(5, shift2);
+			break;
+		}
+
+		// Run the look-up table event
+		queue.enqueueNDRangeKernel(lookupKernel, cl::NullRange, cl::NDRange(result.IH.size()), cl::NullRange, NULL, &result.lookupEvent);
+	}
+
+	// Read the look-up table data from the device back to the host
+	queue.enqueueReadBuffer(lookupBuffer, CL_TRUE, 0, histoSize, &result.LUT[0], NULL, transfer("Look-up Table", "read", histoSize));
+}
+
+void HistogramEqualiser::backprojectStage(int backprojectChoice, int binCount, int increments, int width, int height, size_t intensitySize, const cl::NDRange& tile, int itemsPerThread, int groupsPerComputeUnit) {
+	/*
+	---------------- BACK-PROJECTION ----------------
+	*/
+
+	int pixelCount = width * height;
+
+	// Prepare the kernel for the back-projection
+	CachedKernel& backprojectKernel = getKernel(result.backprojectFunction);
+
+	// Switch the kernel according to choice.
+	switch (backprojectChoice) {
+	case 1:
+		// Set the arguments for the back-projection
+		backprojectKernel.setArg(0, imgInputBuffer);
+		backprojectKernel.setArg(1, lookupBuffer);
+		backprojectKernel.setArg(2, imgOutputBuffer);
+		break;
+	case 2:
+	case 3:
+		// Set the arguments for the back-projection
+		backprojectKernel.setArg(0, imgInputBuffer);
+		backprojectKernel.setArg(1, lookupBuffer);
+		backprojectKernel.setArg(2, imgOutputBuffer);
+		backprojectKernel.setArg(3, binCount);
+		backprojectKernel.setArg(4, histoSizeBuffer);
+		break;
+	case 4:
+		// Set the arguments for the back-projection of all three channels
+		backprojectKernel.setArg(0, imgInputBuffer);
+		backprojectKernel.setArg(1, lookupBuffer);
+		backprojectKernel.setArg(2, imgOutputBuffer);
+		backprojectKernel.setArg(3, pixelCount);
+		backprojectKernel.setArg(4, binCount);
+		backprojectKernel.setArg(5, increments);
+		break;
+	case 5:
+		// Set the arguments for the back-projection of the input image into the output image
+		backprojectKernel.setArg(0, imgInputImage);
+		backprojectKernel.setArg(1, lookupBuffer);
+		backprojectKernel.setArg(2, imgOutputImage);
+		backprojectKernel.setArg(3, binCount);
+		backprojectKernel.setArg(4, increments);
+		backprojectKernel.setArg(5, itemsPerThread);
+		break;
+	case 6:
+		// Set the arguments for the back-projection over row tiles
+		backprojectKernel.setArg(0, imgInputBuffer);
+		backprojectKernel.setArg(1, lookupBuffer);
+		backprojectKernel.setArg(2, imgOutputBuffer);
+		backprojectKernel.setArg(3, width);
+		backprojectKernel.setArg(4, height);
+		backprojectKernel.setArg(5, binCount);
+		backprojectKernel.setArg(6, increments);
+		backprojectKernel.setArg(7, itemsPerThread);
+		break;
+	case 7:
+		// Set the arguments for the persistent back-projection
+		backprojectKernel.setArg(0, imgInputBuffer);
+		backprojectKernel.setArg(1, lookupBuffer);
+		backprojectKernel.setArg(2, imgOutputBuffer);
+		backprojectKernel.setArg(3, (int)intensitySize);
+		backprojectKernel.setArg(4, binCount);
+		backprojectKernel.setArg(5, increments);
+		break;
+	}
+
+	// The per-channel back-projection handles every channel of a pixel in one work item
+	cl::NDRange backprojectGlobal = (backprojectChoice == 4) ? cl::NDRange(pixelCount) : cl::NDRange(intensitySize);
+	cl::NDRange backprojectLocal = cl::NullRange;
+
+	// The image and tiled back-projections launch over row tiles, so each dimension is rounded up to whole tiles
+	if (backprojectChoice == 5 || backprojectChoice == 6) {
+		backprojectLocal = tile;
+		backprojectGlobal = tiledRange(width, height, tile, itemsPerThread);
+	}
+
+	// The persistent back-projection launches a fixed number of work groups for the device, which stride over the image
+	if (backprojectChoice == 7) {
+		backprojectLocal = persistentGroup(device);
+		backprojectGlobal = persistentRange(device, groupsPerComputeUnit, intensitySize);
+	}
+
+	// Run the back-projection event
+	queue.enqueueNDRangeKernel(backprojectKernel, cl::NullRange, backprojectGlobal, backprojectLocal, NULL, &result.backprojectEvent);
+}
+
+void HistogramEqualiser::bandHistogram(const uint16_t* band, int pixelCount, const EqualiserOptions& options, vector<int>& histogram) {
+	int binCount = options.binCount;
+	size_t histoSize = binCount * sizeof(int);
+	useProgram(options);
+
+	// Write the band to the input buffer and clear the histogram
+	reserve(imgInputBuffer, imgInputCapacity, pixelCount * sizeof(uint16_t));
+	reserve(intHistoBuffer, intHistoCapacity, histoSize);
+	queue.enqueueWriteBuffer(imgInputBuffer, CL_TRUE, 0, pixelCount * sizeof(uint16_t), band);
+	queue.enqueueFillBuffer(intHistoBuffer, 0, 0, histoSize);
+
+	// Count the band with the variable intensity histogram, whose counts add up exactly across bands
+	CachedKernel& intHistoKernel = getKernel("intHistogram2");
+	intHistoKernel.setArg(0, imgInputBuffer);
+	intHistoKernel.setArg(1, intHistoBuffer);
+	intHistoKernel.setArg(2, binCount);
+	intHistoKernel.setArg(3, (options.maxIntensity + 1) / binCount);
+	queue.enqueueNDRangeKernel(intHistoKernel, cl::NullRange, cl::NDRange(pixelCount), cl::NullRange, NULL, &result.intHistoEvent);
+
+	// Read the partial histogram back for merging
+	histogram.resize(binCount);
+	queue.enqueueReadBuffer(intHistoBuffer, CL_TRUE, 0, histoSize, &histogram[0]);
+}
+
+const EqualiserResult& HistogramEqualiser::lookupTable(const vector<int>& histogram, const EqualiserOptions& options) {
+	int binCount = options.binCount;
+	size_t histoSize = binCount * sizeof(int);
+	bool histogramMatching = !options.targetCDF.empty();
+	useProgram(options);
+
+	// Fall back from the scans and look-up tables that cannot run with these options or on this device
+	int cumHistoChoice = selectScan(options);
+	int lookupChoice = selectLookup(options);
+
+	// Record the kernels of the stages that are run here
+	result.intHistoFunction = "intHistogram2";
+	result.cumHistoFunction = cumHistoFunctions[cumHistoChoice];
+	result.lookupFunction = histogramMatching ? "histogramMatch" : (cumHistoChoice == 5) ? result.cumHistoFunction : lookupFunctions[lookupChoice];
+
+	// Write the merged histogram in place of the intensity histogram stage
+	result.transfers.clear();
+	result.bufferRequests = 0;
+	result.bufferAllocations = 0;
+	reserve(intHistoBuffer, intHistoCapacity, histoSize);
+	reserve(cumHistoBuffer, cumHistoCapacity, histoSize);
+	reserve(lookupBuffer, lookupCapacity, histoSize);
+	if (histogramMatching) {
+		reserveTarget(histoSize);
+	}
+	queue.enqueueWriteBuffer(intHistoBuffer, CL_TRUE, 0, histoSize, &histogram[0], NULL, transfer("Intensity Histogram", "write", histoSize));
+
+	result.IH = histogram;
+	result.CH.resize(binCount);
+	result.LUT.resize(binCount);
+
+	lookupStages(options, cumHistoChoice, lookupChoice, 1);
+
+	return result;
+}
+
+void HistogramEqualiser::bandBackprojection(const uint16_t* band, uint16_t* out, int pixelCount, const vector<int>& lut, const EqualiserOptions& options) {
+	int binCount = options.binCount;
+	int increments = (options.maxIntensity + 1) / binCount;
+	size_t histoSize = binCount * sizeof(int);
+	useProgram(options);
+
+	// The binned back-projections compare each value against the bounds of every bin
+	fillBinValues(binCount, options.maxIntensity);
+
+	// Write the band, the look-up table and the bin bounds
+	reserve(imgInputBuffer, imgInputCapacity, pixelCount * sizeof(uint16_t));
+	reserve(imgOutputBuffer, imgOutputCapacity, pixelCount * sizeof(uint16_t));
+	reserve(lookupBuffer, lookupCapacity, histoSize);
+	reserve(histoSizeBuffer, histoSizeCapacity, binValues.size() * sizeof(int));
+	queue.enqueueWriteBuffer(imgInputBuffer, CL_TRUE, 0, pixelCount * sizeof(uint16_t), band);
+	queue.enqueueWriteBuffer(lookupBuffer, CL_TRUE, 0, histoSize, &lut[0]);
+	queue.enqueueWriteBuffer(histoSizeBuffer, CL_TRUE, 0, binValues.size() * sizeof(int), &binValues[0]);
+
+	int backprojectChoice = selectBackprojection(options);
+	result.backprojectFunction = backprojectFunctions[backprojectChoice];
+	backprojectStage(backprojectChoice, binCount, increments, pixelCount, 1, pixelCount, cl::NullRange, 1, 1);
+
+	queue.enqueueReadBuffer(imgOutputBuffer, CL_TRUE, 0, pixelCount * sizeof(uint16_t), out);
+}
+
+vector<int> HistogramEqualiser::targetCDF(const uint16_t* reference, int width, int height, int channels, const EqualiserOptions& options) {
+	int binCount = options.binCount;
+	int pixelCount = width * height;
+	size_t histoSize = binCount * sizeof(int);
+	useProgram(options);
+
+	// The device colour spaces match on the same channel for the reference as for the image, so an RGB reference is converted by the same kernel
+	string colourToFunction = colourFunctions(options.colourMode).first;
+	bool deviceColour = (channels == 3) && !colourToFunction.empty();
+
+	// Otherwise use the luma channel of an RGB reference image, which is the first plane after the conversion to YCbCr
+	// The reference is converted in its own image, as the YCbCr image of the equaliser is a view of its pinned memory sized for the last equalisation
+	const uint16_t* luma = reference;
+	cimg_library::CImg<unsigned short> referenceYCbCr;
+	if (channels == 3 && !deviceColour) {
+		referenceYCbCr.assign(reference, width, height, 1, 3);
+		referenceYCbCr.RGBtoYCbCr();
+		luma = referenceYCbCr.data();
+	}
+
+	reserve(imgInputBuffer, imgInputCapacity, pixelCount * sizeof(uint16_t));
+	reserve(intHistoBuffer, intHistoCapacity, histoSize);
+	reserveTarget(histoSize);
+
+	// Write the RGB reference image to the device and convert it, leaving the matched channel in the input buffer
+	if (deviceColour) {
+		reserve(colourBuffer, colourCapacity, 3 * (size_t)pixelCount * sizeof(uint16_t));
+		reserve(chromaBuffer, chromaCapacity, 2 * (size_t)pixelCount * sizeof(float));
+		queue.enqueueWriteBuffer(colourBuffer, CL_TRUE, 0, 3 * (size_t)pixelCount * sizeof(uint16_t), reference);
+
+		CachedKernel& colourToKernel = getKernel(colourToFunction);
+		colourToKernel.setArg(0, colourBuffer);
+		colourToKernel.setArg(1, imgInputBuffer);
+		colourToKernel.setArg(2, chromaBuffer);
+		colourToKernel.setArg(3, pixelCount);
+		colourToKernel.setArg(4, options.maxIntensity);
+		queue.enqueueNDRangeKernel(colourToKernel, cl::NullRange, cl::NDRange(pixelCount), cl::NullRange);
+	}
+
+	// Otherwise write the reference image data to the input buffer
+	else {
+		queue.enqueueWriteBuffer(imgInputBuffer, CL_TRUE, 0, pixelCount * sizeof(uint16_t), luma);
+	}
+	queue.enqueueFillBuffer(intHistoBuffer, 0, 0, histoSize);
+
+	// Calculate the intensity histogram of the reference image
+	CachedKernel& referenceHistoKernel = getKernel("intHistogram2");
+	referenceHistoKernel.setArg(0, imgInputBuffer);
+	referenceHistoKernel.setArg(1, intHistoBuffer);
+	referenceHistoKernel.setArg(2, binCount);
+	referenceHistoKernel.setArg(3, (options.maxIntensity + 1) / binCount);
+	queue.enqueueNDRangeKernel(referenceHistoKernel, cl::NullRange, cl::NDRange(pixelCount), cl::NullRange);
+
+	// Calculate the cumulative histogram of the reference image into the target buffer
+	CachedKernel& referenceCumKernel = getKernel("cumHistogramHS2");
+	referenceCumKernel.setArg(0, intHistoBuffer);
+	referenceCumKernel.setArg(1, targetCDFBuffer);
+	referenceCumKernel.setArg(2, cl::Local(histoSize));
+	referenceCumKernel.setArg(3, cl::Local(histoSize));
+	queue.enqueueNDRangeKernel(referenceCumKernel, cl::NullRange, cl::NDRange(binCount), cl::NDRange(binCount));
+
+	vector<int> targetCDF(binCount);
+	queue.enqueueReadBuffer(targetCDFBuffer, CL_TRUE, 0, histoSize, &targetCDF[0]);
+
+	// The target buffer now holds the cumulative histogram of the reference image
+	deviceTarget = targetCDF;
+	return targetCDF;
+}
@@ -0,0 +1,61 @@
+#include "include/KernelRegistry.h"
+
+bool CachedKernel::isBound(cl_uint index, size_t size, const void* pointer) {
+	if (index >= arguments.size() || !arguments[index].set) {
+		return false;
+	}
+
+	// A local memory argument only matches another of the same size, and a value only matches the same bytes
+	const BoundArgument& bound = arguments[index];
+	bool matches = (bound.size == size) && (bound.local == (pointer == NULL)) &&
+		(pointer == NULL || memcmp(bound.bytes.data(), pointer, size) == 0);
+
+	if (matches) {
+		argumentsSkipped++;
+	}
+	return matches;
+}
+
+void CachedKernel::remember(cl_uint index, size_t size, const void* pointer, const cl::Memory& memory) {
+	if (index >= arguments.size()) {
+		arguments.resize(index + 1);
+	}
+
+	BoundArgument& bound = arguments[index];
+	bound.set = true;
+	bound.local = (pointer == NULL);
+	bound.size = size;
+	if (bound.local) {
+		bound.bytes.clear();
+	}
+	else {
+		bound.bytes.assign((const unsigned char*)pointer, (const unsigned char*)pointer + size);
+	}
+	bound.memory = memory;
+	argumentsSet++;
+}
+
+CachedKernel& KernelRegistry::get(const cl::Program& program, const string& programKey, const string& name) {
+	// Create the kernel the first time it is requested, so that later calls only change the arguments that differ
+	auto kernel = kernels.find({ programKey, name });
+	if (kernel == kernels.end()) {
+		kernel = kernels.emplace(make_pair(programKey, name), CachedKernel(cl::Kernel(program, name.c_str()))).first;
+	}
+	return kernel->second;
+}
+
+cl_ulong KernelRegistry::getArgumentsSet() const {
+	cl_ulong total = 0;
+	for (const auto& kernel : kernels) {
+		total += kernel.second.getArgumentsSet();
+	}
+	return total;
+}
+
+cl_ulong KernelRegistry::getArgumentsSkipped() const {
+	cl_ulong total = 0;
+	for (const auto& kernel : kernels) {
+		total += kernel.second.getArgumentsSkipped();
+	}
+	return total;
+}
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include "include/MetricsRecorder.h"
+
+double StageMetric::pixelsPerSecond() const {
+	return duration() > 0 ? (double)width * height * 1e9 / duration() : 0.0;
+}
+
+double StageMetric::gigabytesPerSecond() const {
+	// Bytes per nanosecond are gigabytes per second
+	return duration() > 0 ? (double)bytes / duration() : 0.0;
+}
+
+double StageMetric::poolHitRate() const {
+	return bufferRequests > 0 ? (double)(bufferRequests - bufferAllocations) / bufferRequests : 0.0;
+}
+
+// Quote a CSV field when it holds a separator or a quote
+static string csvField(const string& value) {
+	if (value.find_first_of(",\"") == string::npos) {
+		return value;
+	}
+	string quoted = "\"";
+	for (char c : value) {
+		quoted += c;
+		if (c == '"') {
+			quoted += '"';
+		}
+	}
+	return quoted + "\"";
+}
+
+void MetricsRecorder::add(int run, const string& device, const string& stage, const string& command, const string& kernel, size_t bytes, bool pinned, const cl::Event& event, const EqualiserResult& result, const EqualiserOptions& options, int width, int height, int channels) {
+	StageMetric metric;
+	metric.run = run;
+	metric.device = device;
+	metric.stage = stage;
+	metric.command = command;
+	metric.kernel = kernel;
+	metric.bytes = bytes;
+	metric.pinned = pinned;
+	metric.binCount = options.binCount;
+	metric.width = width;
+	metric.height = height;
+	metric.channels = channels;
+	metric.bufferRequests = result.bufferRequests;
+	metric.bufferAllocations = result.bufferAllocations;
+	metric.queued = event.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>();
+	metric.submitted = event.getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>();
+	metric.started = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+	metric.ended = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+	metrics.push_back(metric);
+}
+
+void MetricsRecorder::recordEqualisation(const EqualiserResult& result, const string& device, int width, int height, int channels, const EqualiserOptions& options) {
+	// The histograms hold one set of bins per equalised plane, which gives the number of values each kernel reads
+	size_t pixelCount = (size_t)width * height;
+	size_t planeCount = result.IH.size() / options.binCount;
+	size_t intensityBytes = planeCount * pixelCount * sizeof(uint16_t);
+	size_t histoBytes = result.IH.size() * sizeof(int);
+
+	// The colour conversions read or write the RGB image, the intensity plane and the two float planes that are kept
+	size_t colourBytes = 3 * pixelCount * sizeof(uint16_t) + pixelCount * sizeof(uint16_t) + 2 * pixelCount * sizeof(float);
+
+	// The fused cumulative histogram also writes the look-up table, and its event is then not recorded a second time
+	bool lookupFused = (result.lookupFunction == result.cumHistoFunction);
+
+	lock_guard<mutex> lock(metricsMutex);
+	int run = runCount++;
+	size_t first = metrics.size();
+
+	if (!result.colourToFunction.empty()) {
+		add(run, device, "Colour Conversion", "kernel", result.colourToFunction, colourBytes, false, result.colourToEvent, result, options, width, height, channels);
+	}
+	add(run, device, "Intensity Histogram", "kernel", result.intHistoFunction, intensityBytes + histoBytes, false, result.intHistoEvent, result, options, width, height, channels);
+	add(run, device, "Cumulative Histogram", "kernel", result.cumHistoFunction, (lookupFused ? 3 : 2) * histoBytes, false, result.cumHistoEvent, result, options, width, height, channels);
+	if (!lookupFused) {
+		add(run, device, "Look-up Table", "kernel", result.lookupFunction, 2 * histoBytes, false, result.lookupEvent, result, options, width, height, channels);
+	}
+	add(run, device, "Back-Projection", "kernel", result.backprojectFunction, 2 * intensityBytes + histoBytes, false, result.backprojectEvent, result, options, width, height, channels);
+	if (!result.colourFromFunction.empty()) {
+		add(run, device, "Colour Reversion", "kernel", result.colourFromFunction, colourBytes, false, result.colourFromEvent, result, options, width, height, channels);
+	}
+
+	for (const EqualiserTransfer& transfer : result.transfers) {
+		add(run, device, transfer.stage, transfer.command, "", transfer.bytes, transfer.pinned, transfer.event, result, options, width, height, channels);
+	}
+
+	// List the commands of the run in the order they were queued
+	stable_sort(metrics.begin() + first, metrics.end(), [](const StageMetric& a, const StageMetric& b) { return a.queued < b.queued; });
+}
+
+void MetricsRecorder::writeJSON(ostream& out) const {
+	lock_guard<mutex> lock(metricsMutex);
+	out << "[" << endl;
+	for (size_t i = 0; i < metrics.size(); i++) {
+		const StageMetric& metric = metrics[i];
+		out << "  {\"run\": " << metric.run << ", \"device\": " << JsonString(metric.device) << ", \"stage\": " << JsonString(metric.stage)
+			<< ", \"command\": " << JsonString(metric.command) << ", \"kernel\": " << JsonString(metric.kernel) << ", \"bytes\": " << metric.bytes << ", \"pinned\": " << (metric.pinned ? "true" : "false")
+			<< ", \"binCount\": " << metric.binCount << ", \"width\": " << metric.width << ", \"height\": " << metric.height << ", \"channels\": " << metric.channels
+			<< ", \"bufferRequests\": " << metric.bufferRequests << ", \"bufferAllocations\": " << metric.bufferAllocations << ", \"poolHitRate\": " << metric.poolHitRate()
+			<< ", \"queuedNs\": " << metric.queued << ", \"submittedNs\": " << metric.submitted << ", \"startedNs\": " << metric.started << ", \"endedNs\": " << metric.ended
+			<< ", \"durationNs\": " << metric.duration() << ", \"pixelsPerSecond\": " << metric.pixelsPerSecond() << ", \"gigabytesPerSecond\": " << metric.gigabytesPerSecond() << "}"
+			<< (i + 1 < metrics.size() ? "," : "") << endl;
+	}
+	out << "]" << endl;
+}
+
+void MetricsRecorder::writeCSV(ostream& out) const {
+	lock_guard<mutex> lock(metricsMutex);
+	out << "run,device,stage,command,kernel,bytes,pinned,binCount,width,height,channels,bufferRequests,bufferAllocations,poolHitRate,queuedNs,submittedNs,startedNs,endedNs,durationNs,pixelsPerSecond,gigabytesPerSecond" << endl;
+	for (const StageMetric& metric : metrics) {
+		out << metric.run << "," << csvField(metric.device) << "," << csvField(metric.stage) << "," << metric.command << "," << metric.kernel << "," << metric.bytes << "," << (metric.pinned ? 1 : 0)
+			<< "," << metric.binCount << "," << metric.width << "," << metric.height << "," << metric.channels
+			<< "," << metric.bufferRequests << "," << metric.bufferAllocations << "," << metric.poolHitRate()
+			<< "," << metric.queued << "," << metric.submitted << "," << metric.started << "," << metric.ended
+			<< "," << metric.duration() << "," << metric.pixelsPerSecond() << "," << metric.gigabytesPerSecond() << endl;
+	}
+}
+
+bool MetricsRecorder::write(const string& fileName) const {
+	ofstream file(fileName);
+	if (!file) {
+		return false;
+	}
+
+	// Keep the full precision of the derived metrics
+	file << setprecision(10);
+	if (fileName.size() >= 4 && fileName.compare(fileName.size() - 4, 4, ".csv") == 0) {
+		writeCSV(file);
+	}
+	else {
+		writeJSON(file);
+	}
+
+	return (bool)file;
+}
+
+vector<StageMetric> MetricsRecorder::getMetrics() const {
+	lock_guard<mutex> lock(metricsMutex);
+	return metrics;
+}
+
+size_t MetricsRecorder::size() const {
+	lock_guard<mutex> lock(metricsMutex);
+	return metrics.size();
+}
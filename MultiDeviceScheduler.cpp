@@ -0,0 +1,273 @@
+#include <cstring>
+#include "include/MultiDeviceScheduler.h"
+
+MultiDeviceScheduler::MultiDeviceScheduler(const vector<cl::Device>& deviceList, const string& kernelFile) {
+	devices.resize(deviceList.size());
+
+	// Build the program separately for each device, so that devices from different platforms can be mixed
+	for (size_t i = 0; i < deviceList.size(); i++) {
+		cl::Context context({ deviceList[i] });
+		cl::Program program = HistogramEqualiser::buildProgram(context, kernelFile);
+		devices[i].equaliser.reset(new HistogramEqualiser(context, program, deviceList[i]));
+		devices[i].name = deviceList[i].getInfo<CL_DEVICE_NAME>();
+	}
+}
+
+vector<cl::Device> MultiDeviceScheduler::allDevices() {
+	vector<cl::Device> devices;
+	vector<cl::Platform> platforms;
+	cl::Platform::get(&platforms);
+
+	for (cl::Platform& platform : platforms) {
+		vector<cl::Device> platformDevices;
+		platform.getDevices((cl_device_type)CL_DEVICE_TYPE_ALL, &platformDevices);
+		devices.insert(devices.end(), platformDevices.begin(), platformDevices.end());
+	}
+
+	return devices;
+}
+
+vector<cl::Device> MultiDeviceScheduler::numaSubDevices(const cl::Device& device) {
+	// Keep the whole device when the runtime cannot split it by NUMA node
+	if ((device.getInfo<CL_DEVICE_PARTITION_AFFINITY_DOMAIN>() & CL_DEVICE_AFFINITY_DOMAIN_NUMA) == 0) {
+		return { device };
+	}
+
+	const cl_device_partition_property properties[] = { CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN, CL_DEVICE_AFFINITY_DOMAIN_NUMA, 0 };
+	vector<cl::Device> subDevices;
+
+	// The partition fails on hosts with a single NUMA node, which also leaves the whole device
+	try {
+		cl::Device(device).createSubDevices(properties, &subDevices);
+	}
+	catch (const cl::Error&) {
+		return { device };
+	}
+
+	return subDevices.empty() ? vector<cl::Device>{ device } : subDevices;
+}
+
+bool MultiDeviceScheduler::take(size_t device, size_t& index) {
+	lock_guard<mutex> lock(queueMutex);
+
+	// Serve the own queue from the front, which holds the earliest requests of its share
+	if (!devices[device].queue.empty()) {
+		index = devices[device].queue.front();
+		devices[device].queue.pop_front();
+		return true;
+	}
+
+	// Otherwise steal from the back of the device with the most requests left
+	size_t victim = device;
+	for (size_t i = 0; i < devices.size(); i++) {
+		if (devices[i].queue.size() > devices[victim].queue.size()) {
+			victim = i;
+		}
+	}
+
+	if (devices[victim].queue.empty()) {
+		return false;
+	}
+
+	index = devices[victim].queue.back();
+	devices[victim].queue.pop_back();
+	return true;
+}
+
+vector<int> MultiDeviceScheduler::equaliseBatch(const vector<EqualiseRequest>& requests) {
+	vector<int> servedBy(requests.size(), -1);
+
+	// Give each device a contiguous share of the batch in proportion to its throughput
+	vector<size_t> bounds = shares(requests.size());
+	{
+		lock_guard<mutex> lock(queueMutex);
+		for (size_t i = 0; i < devices.size(); i++) {
+			for (size_t next = bounds[i]; next < bounds[i + 1]; next++) {
+				devices[i].queue.push_back(next);
+			}
+		}
+	}
+
+	vector<cl_ulong> batchPixels(devices.size(), 0);
+	vector<double> batchSeconds(devices.size(), 0.0);
+
+	// Run each device until every queue is empty, where a device that fails leaves the remaining requests to the others
+	runOnDevices([&](size_t device) {
+		size_t index;
+		while (take(device, index)) {
+			const EqualiseRequest& request = requests[index];
+			chrono::steady_clock::time_point started = chrono::steady_clock::now();
+			const EqualiserResult& result = devices[device].equaliser->equalise(request.in, request.out, request.width, request.height, request.channels, request.options);
+			chrono::steady_clock::time_point finished = chrono::steady_clock::now();
+			batchSeconds[device] += chrono::duration<double>(finished - started).count();
+			batchPixels[device] += (cl_ulong)request.width * request.height;
+			servedBy[index] = (int)device;
+
+			if (metrics) {
+				metrics->recordEqualisation(result, devices[device].name, request.width, request.height, request.channels, request.options);
+			}
+			if (timers) {
+				timers->record("Batch Image", started, finished);
+				timers->recordEqualisation(result);
+			}
+		}
+	});
+
+	for (size_t i = 0; i < devices.size(); i++) {
+		devices[i].images += count(servedBy.begin(), servedBy.end(), (int)i);
+		recordThroughput(i, batchPixels[i], batchSeconds[i]);
+	}
+
+	return servedBy;
+}
+
+void MultiDeviceScheduler::equaliseSplit(const uint16_t* in, uint16_t* out, int width, int height, int channels, const EqualiserOptions& options) {
+	int pixelCount = width * height;
+
+	// Only the YCbCr luma of an RGB image is split, which histogram matching also uses in the RGB colour mode
+	bool lumaMode = options.colourMode == "ycbcr" || (options.colourMode == "rgb" && !options.targetCDF.empty());
+	if (channels == 3 && !lumaMode) {
+		throw invalid_argument("the split mode cannot equalise RGB images in the " + options.colourMode + " colour mode");
+	}
+
+	// The bands are back-projected on their own, so the per-channel and launch-specific back-projections cannot be used
+	if (options.backprojectChoice < 1 || options.backprojectChoice > 3) {
+		throw invalid_argument("the split mode needs back-projection 1, 2 or 3, not " + to_string(options.backprojectChoice));
+	}
+
+	// Split the luma channel of an RGB image, converting it on the host as the single-device path does
+	const uint16_t* plane = in;
+	uint16_t* outPlane = out;
+	if (channels == 3) {
+		imgYCbCr.assign(in, width, height, 1, 3);
+		imgYCbCr.RGBtoYCbCr();
+		plane = imgYCbCr.data();
+		outPlane = imgYCbCr.data();
+	}
+
+	// Give each device a band of rows in proportion to its throughput
+	vector<size_t> rows = shares(height);
+	vector<vector<int>> partialHistograms(devices.size());
+	vector<cl_ulong> bandPixels(devices.size(), 0);
+	vector<double> bandSeconds(devices.size(), 0.0);
+
+	// Count the bins of every band in parallel
+	runOnDevices([&](size_t device) {
+		int bandPixelCount = (int)(rows[device + 1] - rows[device]) * width;
+		if (bandPixelCount > 0) {
+			chrono::steady_clock::time_point started = chrono::steady_clock::now();
+			devices[device].equaliser->bandHistogram(plane + rows[device] * width, bandPixelCount, options, partialHistograms[device]);
+			bandSeconds[device] += chrono::duration<double>(chrono::steady_clock::now() - started).count();
+		}
+	});
+
+	// Merge the partial histograms, whose counts add up to the histogram of the whole image
+	vector<int> histogram(options.binCount, 0);
+	for (vector<int>& partialHistogram : partialHistograms) {
+		for (size_t i = 0; i < partialHistogram.size(); i++) {
+			histogram[i] += partialHistogram[i];
+		}
+	}
+
+	// Build the look-up table once, on the first device
+	vector<int> lut = devices[0].equaliser->lookupTable(histogram, options).LUT;
+
+	// Back-project every band on the device that counted it
+	runOnDevices([&](size_t device) {
+		int bandPixelCount = (int)(rows[device + 1] - rows[device]) * width;
+		if (bandPixelCount > 0) {
+			chrono::steady_clock::time_point started = chrono::steady_clock::now();
+			devices[device].equaliser->bandBackprojection(plane + rows[device] * width, outPlane + rows[device] * width, bandPixelCount, lut, options);
+			bandSeconds[device] += chrono::duration<double>(chrono::steady_clock::now() - started).count();
+			bandPixels[device] = bandPixelCount;
+		}
+	});
+
+	// Convert the equalised luma channel back into RGB
+	if (channels == 3) {
+		imgYCbCr.YCbCrtoRGB();
+		memcpy(out, imgYCbCr.data(), 3 * (size_t)pixelCount * sizeof(uint16_t));
+	}
+
+	for (size_t i = 0; i < devices.size(); i++) {
+		recordThroughput(i, bandPixels[i], bandSeconds[i]);
+	}
+}
+
+vector<size_t> MultiDeviceScheduler::shares(size_t count) const {
+	double totalWeight = 0.0;
+	for (const DeviceState& state : devices) {
+		totalWeight += state.weight;
+	}
+
+	// Round the running share so that the bounds always increase and the last one is the count
+	vector<size_t> bounds(devices.size() + 1, 0);
+	double share = 0.0;
+	for (size_t i = 0; i < devices.size(); i++) {
+		share += devices[i].weight / totalWeight;
+		bounds[i + 1] = (i == devices.size() - 1) ? count : max(bounds[i], min(count, (size_t)(share * count + 0.5)));
+	}
+
+	return bounds;
+}
+
+void MultiDeviceScheduler::runOnDevices(const function<void(size_t)>& work) {
+	vector<exception_ptr> errors(devices.size());
+	vector<thread> threads;
+
+	// Run a thread per device, keeping any error until every thread has finished
+	for (size_t device = 0; device < devices.size(); device++) {
+		threads.emplace_back([&, device] {
+			try {
+				work(device);
+			}
+			catch (...) {
+				errors[device] = current_exception();
+			}
+		});
+	}
+
+	for (thread& worker : threads) {
+		worker.join();
+	}
+
+	for (exception_ptr& error : errors) {
+		if (error) {
+			rethrow_exception(error);
+		}
+	}
+}
+
+void MultiDeviceScheduler::recordThroughput(size_t device, cl_ulong pixels, double seconds) {
+	DeviceState& state = devices[device];
+	state.pixels += pixels;
+	state.busySeconds += seconds;
+
+	// Update the throughput of a device that took part, smoothing over calls
+	if (seconds > 0.0) {
+		double throughput = pixels / seconds;
+		state.weight = state.measured ? 0.5 * state.weight + 0.5 * throughput : throughput;
+		state.measured = true;
+	}
+}
+
+void MultiDeviceScheduler::printStatistics(ostream& out) const {
+	for (size_t i = 0; i < devices.size(); i++) {
+		const DeviceState& state = devices[i];
+		out << "Device " << i << ", " << state.name << ": ";
+
+		// Bands of split images are counted as pixels only
+		if (state.images > 0) {
+			out << state.images << " images, ";
+		}
+		out << state.pixels << " pixels, busy " << state.busySeconds << " [s]";
+		if (state.busySeconds > 0.0) {
+			out << ", " << state.pixels / state.busySeconds << " pixels/s";
+		}
+
+		// Each device has a context and so a buffer pool of its own
+		BufferPoolStatistics buffers = state.equaliser->getBufferPool().getStatistics();
+		out << ", " << buffers.allocations << " buffers allocated, pool hit rate " << buffers.hitRate() * 100.0 << "%";
+		out << endl;
+	}
+}
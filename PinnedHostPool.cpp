@@ -0,0 +1,63 @@
+#include "include/PinnedHostPool.h"
+
+PinnedHostPool::PinnedHostPool(const cl::Context& context) : context(context) {
+	queue = cl::CommandQueue(context, context.getInfo<CL_CONTEXT_DEVICES>()[0]);
+}
+
+PinnedHostPool::~PinnedHostPool() {
+	// The equalisers holding buffers of the pool have been destroyed with it, so every mapping can be released
+	try {
+		for (PinnedBuffer& pinned : allocated) {
+			queue.enqueueUnmapMemObject(pinned.buffer, pinned.host);
+		}
+		queue.finish();
+	}
+	catch (const cl::Error&) {
+	}
+}
+
+bool PinnedHostPool::reserve(PinnedBuffer& buffer, size_t size) {
+	size_t wanted = BufferPool::sizeClass(size);
+
+	lock_guard<mutex> lock(poolMutex);
+	statistics.requests++;
+
+	// The buffer already held is of the right class
+	if (buffer.capacity == wanted) {
+		statistics.hits++;
+		return false;
+	}
+
+	// Take the most recently returned buffer of the class, or otherwise allocate and map one before the held buffer is returned
+	vector<PinnedBuffer>& available = freeBuffers[wanted];
+	PinnedBuffer replacement;
+	bool allocate = available.empty();
+	if (allocate) {
+		replacement.buffer = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, wanted);
+		replacement.host = queue.enqueueMapBuffer(replacement.buffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, wanted);
+		replacement.capacity = wanted;
+		allocated.push_back(replacement);
+		statistics.allocations++;
+		statistics.allocatedBytes += wanted;
+	}
+	else {
+		replacement = available.back();
+		available.pop_back();
+		statistics.freeBytes -= wanted;
+		statistics.hits++;
+	}
+
+	// Return the buffer to the pool, so that a later request of its class can reuse it
+	if (buffer.capacity > 0) {
+		freeBuffers[buffer.capacity].push_back(buffer);
+		statistics.freeBytes += buffer.capacity;
+	}
+
+	buffer = replacement;
+	return allocate;
+}
+
+BufferPoolStatistics PinnedHostPool::getStatistics() const {
+	lock_guard<mutex> lock(poolMutex);
+	return statistics;
+}
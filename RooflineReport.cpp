@@ -0,0 +1,73 @@
+#include <iomanip>
+#include "include/RooflineReport.h"
+
+RooflineReport::RooflineReport(HistogramEqualiser& equaliser, size_t copyBytes, int repetitions) {
+	const cl::Context& context = equaliser.getContext();
+	cl::CommandQueue& queue = equaliser.getQueue();
+
+	// The copy moves sixteen bytes per work item
+	size_t copyItems = copyBytes / 16;
+	copyBytes = copyItems * 16;
+	cl::Buffer copyInput(context, CL_MEM_READ_ONLY, copyBytes);
+	cl::Buffer copyOutput(context, CL_MEM_WRITE_ONLY, copyBytes);
+	queue.enqueueFillBuffer(copyInput, 0, 0, copyBytes);
+
+	cl::Kernel copyKernel(equaliser.getProgram(), "copyCalibration");
+	copyKernel.setArg(0, copyInput);
+	copyKernel.setArg(1, copyOutput);
+
+	// The atomics increment 256 bins, as many times as there are pixels in a 4096 by 4096 image, capped by the copy size to keep the calibration short
+	const int binCount = 256;
+	size_t atomicItems = min((size_t)4096 * 4096, copyItems);
+	cl::Buffer bins(context, CL_MEM_READ_WRITE, binCount * sizeof(int));
+
+	cl::Kernel atomicKernel(equaliser.getProgram(), "atomicCalibration");
+	atomicKernel.setArg(0, bins);
+	atomicKernel.setArg(1, binCount);
+
+	// Keep the fastest repetition, which is the least disturbed by the rest of the system
+	for (int i = 0; i < repetitions; i++) {
+		cl::Event copyEvent;
+		queue.enqueueNDRangeKernel(copyKernel, cl::NullRange, cl::NDRange(copyItems), cl::NullRange, NULL, &copyEvent);
+		copyEvent.wait();
+		cl_ulong copyTime = copyEvent.getProfilingInfo<CL_PROFILING_COMMAND_END>() - copyEvent.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+		if (copyTime > 0) {
+			copyBandwidth = max(copyBandwidth, 2.0 * copyBytes / copyTime);
+		}
+
+		cl::Event atomicEvent;
+		queue.enqueueFillBuffer(bins, 0, 0, binCount * sizeof(int));
+		queue.enqueueNDRangeKernel(atomicKernel, cl::NullRange, cl::NDRange(atomicItems), cl::NullRange, NULL, &atomicEvent);
+		atomicEvent.wait();
+		cl_ulong atomicTime = atomicEvent.getProfilingInfo<CL_PROFILING_COMMAND_END>() - atomicEvent.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+		if (atomicTime > 0) {
+			atomicRate = max(atomicRate, atomicItems * 1e9 / atomicTime);
+		}
+	}
+}
+
+void RooflineReport::print(ostream& out, const vector<StageMetric>& metrics) const {
+	out << "Copy Bandwidth [GB/s]: " << copyBandwidth << endl;
+	out << "Atomic Throughput [increments/s]: " << atomicRate << endl << endl;
+
+	out << left << setw(22) << "Stage" << setw(26) << "Kernel" << right << setw(14) << "Time [ns]" << setw(12) << "GB/s" << setw(10) << "% Copy" << setw(16) << "Increments/s" << setw(10) << "% Atomic" << endl;
+
+	for (const StageMetric& metric : metrics) {
+		if (metric.command != "kernel") {
+			continue;
+		}
+
+		double bandwidth = metric.gigabytesPerSecond();
+		out << left << setw(22) << metric.stage << setw(26) << metric.kernel << right << setw(14) << metric.duration()
+			<< fixed << setprecision(3) << setw(12) << bandwidth << setprecision(1) << setw(10) << (copyBandwidth > 0.0 ? 100.0 * bandwidth / copyBandwidth : 0.0);
+
+		// The intensity histograms make one increment for every value of the image
+		if (metric.kernel.compare(0, 12, "intHistogram") == 0 && metric.duration() > 0) {
+			double values = (double)metric.width * metric.height * (metric.kernel == "intHistogramRGB" ? metric.channels : 1);
+			double rate = values * 1e9 / metric.duration();
+			out << scientific << setprecision(3) << setw(16) << rate << fixed << setprecision(1) << setw(10) << (atomicRate > 0.0 ? 100.0 * rate / atomicRate : 0.0);
+		}
+
+		out << defaultfloat << setprecision(6) << endl;
+	}
+}
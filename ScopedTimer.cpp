@@ -0,0 +1,91 @@
+#include <iomanip>
+#include "include/ScopedTimer.h"
+
+StageTimers::StageTimers() : created(chrono::steady_clock::now()) {}
+
+StageTimers::Entry& StageTimers::entry(const string& name, int entryDepth) {
+	for (Entry& existing : entries) {
+		if (existing.name == name && existing.depth == entryDepth) {
+			return existing;
+		}
+	}
+	entries.push_back({ name, entryDepth, 0, 0.0, 0.0, 0.0 });
+	return entries.back();
+}
+
+void StageTimers::add(const string& name, int entryDepth, chrono::steady_clock::time_point start, chrono::steady_clock::time_point end, bool traced) {
+	double seconds = chrono::duration<double>(end - start).count();
+
+	lock_guard<mutex> lock(timersMutex);
+	Entry& timed = entry(name, entryDepth);
+	timed.minimum = (timed.count == 0) ? seconds : min(timed.minimum, seconds);
+	timed.maximum = (timed.count == 0) ? seconds : max(timed.maximum, seconds);
+	timed.total += seconds;
+	timed.count++;
+
+	if (traced && trace) {
+		trace->addHostSpan(name, start, end);
+	}
+}
+
+int StageTimers::currentDepth() const {
+	lock_guard<mutex> lock(timersMutex);
+	return depth;
+}
+
+void StageTimers::record(const string& name, chrono::steady_clock::time_point start, chrono::steady_clock::time_point end) {
+	add(name, currentDepth(), start, end, false);
+}
+
+void StageTimers::recordEqualisation(const EqualiserResult& result) {
+	int spanDepth = currentDepth() + 1;
+	for (const EqualiserSpan& span : result.hostSpans) {
+		add(span.name, spanDepth, span.start, span.end, false);
+	}
+}
+
+void StageTimers::print(ostream& out) const {
+	lock_guard<mutex> lock(timersMutex);
+	double endToEnd = chrono::duration<double>(chrono::steady_clock::now() - created).count();
+
+	out << left << setw(36) << "Step" << right << setw(8) << "Count" << setw(14) << "Total [ms]" << setw(12) << "Mean [ms]" << setw(12) << "Min [ms]" << setw(12) << "Max [ms]" << endl;
+	out << fixed << setprecision(3);
+
+	// Indent the nested steps under the step they ran in, and add up the top-level steps, which do not overlap
+	double accounted = 0.0;
+	for (const Entry& timed : entries) {
+		if (timed.count == 0) {
+			continue;
+		}
+		if (timed.depth == 0) {
+			accounted += timed.total;
+		}
+		out << left << setw(36) << (string(2 * timed.depth, ' ') + timed.name) << right << setw(8) << timed.count << setw(14) << 1e3 * timed.total
+			<< setw(12) << 1e3 * timed.total / timed.count << setw(12) << 1e3 * timed.minimum << setw(12) << 1e3 * timed.maximum << endl;
+	}
+
+	out << endl << "End-to-End Time [ms]: " << 1e3 * endToEnd << endl;
+	out << "Outside the Steps [ms]: " << 1e3 * (endToEnd - accounted) << endl;
+	out << defaultfloat << setprecision(6);
+}
+
+ScopedTimer::ScopedTimer(StageTimers& timers, const string& name) : timers(timers), name(name), start(chrono::steady_clock::now()) {
+	// Add the entry now, so that a step is listed before the steps nested in it
+	lock_guard<mutex> lock(timers.timersMutex);
+	timers.entry(name, timers.depth);
+	timers.depth++;
+}
+
+void ScopedTimer::stop() {
+	if (!running) {
+		return;
+	}
+	running = false;
+
+	int entryDepth;
+	{
+		lock_guard<mutex> lock(timers.timersMutex);
+		entryDepth = --timers.depth;
+	}
+	timers.add(name, entryDepth, start, chrono::steady_clock::now(), true);
+}
@@ -0,0 +1,115 @@
+#include <fstream>
+#include "include/TraceWriter.h"
+
+// The host and device tracks are shown as two processes, with a thread for each device
+static const int hostProcess = 1;
+static const int deviceProcess = 2;
+
+TraceWriter::TraceWriter() : start(now()) {}
+
+cl_long TraceWriter::sinceStart(chrono::steady_clock::time_point time) const {
+	return chrono::duration_cast<chrono::nanoseconds>(time - start).count();
+}
+
+void TraceWriter::addHostSpan(const string& name, chrono::steady_clock::time_point spanStart, chrono::steady_clock::time_point spanEnd) {
+	spans.push_back({ name, "host", -1, 0, sinceStart(spanStart), chrono::duration_cast<chrono::nanoseconds>(spanEnd - spanStart).count() });
+}
+
+void TraceWriter::syncDevice(cl::CommandQueue& queue, const string& deviceName) {
+	// Time a marker from the host, which completes as soon as the commands before it have finished
+	queue.finish();
+	chrono::steady_clock::time_point before = now();
+	cl::Event marker;
+	queue.enqueueMarkerWithWaitList(NULL, &marker);
+	marker.wait();
+	chrono::steady_clock::time_point after = now();
+
+	// Line the end of the marker up with the middle of the host interval, which is within half of the interval of the true offset
+	cl_long hostTime = (sinceStart(before) + sinceStart(after)) / 2;
+	cl_long offset = hostTime - (cl_long)marker.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+
+	for (DeviceTrack& track : deviceTracks) {
+		if (track.name == deviceName) {
+			track.offset = offset;
+			return;
+		}
+	}
+	deviceTracks.push_back({ deviceName, offset });
+}
+
+void TraceWriter::addDeviceSpan(const string& name, const string& category, int track, cl_ulong bytes, const cl::Event& event) {
+	cl_long started = (cl_long)event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+	cl_long ended = (cl_long)event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+	spans.push_back({ name, category, track, bytes, started + deviceTracks[track].offset, ended - started });
+}
+
+void TraceWriter::addEqualisation(const EqualiserResult& result, const string& deviceName) {
+	int track = 0;
+	while (track < (int)deviceTracks.size() && deviceTracks[track].name != deviceName) {
+		track++;
+	}
+	if (track == (int)deviceTracks.size()) {
+		throw invalid_argument("device " + deviceName + " has not been synchronised");
+	}
+
+	// The conversions done on the host
+	for (const EqualiserSpan& span : result.hostSpans) {
+		addHostSpan(span.name, span.start, span.end);
+	}
+
+	// The kernels of each stage, where the fused look-up table shares the event of the cumulative histogram
+	if (!result.colourToFunction.empty()) {
+		addDeviceSpan(result.colourToFunction, "kernel", track, 0, result.colourToEvent);
+	}
+	addDeviceSpan(result.intHistoFunction, "kernel", track, 0, result.intHistoEvent);
+	addDeviceSpan(result.cumHistoFunction, "kernel", track, 0, result.cumHistoEvent);
+	if (result.lookupFunction != result.cumHistoFunction) {
+		addDeviceSpan(result.lookupFunction, "kernel", track, 0, result.lookupEvent);
+	}
+	addDeviceSpan(result.backprojectFunction, "kernel", track, 0, result.backprojectEvent);
+	if (!result.colourFromFunction.empty()) {
+		addDeviceSpan(result.colourFromFunction, "kernel", track, 0, result.colourFromEvent);
+	}
+
+	// The transfers, named by the command and the buffer
+	for (const EqualiserTransfer& transfer : result.transfers) {
+		addDeviceSpan(transfer.command + " " + transfer.stage, transfer.command, track, transfer.bytes, transfer.event);
+	}
+}
+
+bool TraceWriter::write(const string& fileName) const {
+	ofstream file(fileName);
+	if (!file) {
+		return false;
+	}
+
+	file << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [" << endl;
+
+	// Name the processes and the device threads
+	file << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << hostProcess << ", \"tid\": 0, \"args\": {\"name\": \"Host\"}}," << endl;
+	file << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << deviceProcess << ", \"tid\": 0, \"args\": {\"name\": \"Devices\"}}";
+	for (size_t i = 0; i < deviceTracks.size(); i++) {
+		file << "," << endl << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << deviceProcess << ", \"tid\": " << i << ", \"args\": {\"name\": " << JsonString(deviceTracks[i].name) << "}}";
+	}
+
+	// Write each span as a complete event, with the times in microseconds
+	file << fixed;
+	file.precision(3);
+	for (const Span& span : spans) {
+		file << "," << endl << "  {\"name\": " << JsonString(span.name) << ", \"cat\": " << JsonString(span.category) << ", \"ph\": \"X\"";
+		if (span.track < 0) {
+			file << ", \"pid\": " << hostProcess << ", \"tid\": 0";
+		}
+		else {
+			file << ", \"pid\": " << deviceProcess << ", \"tid\": " << span.track;
+		}
+		file << ", \"ts\": " << span.start / 1000.0 << ", \"dur\": " << span.duration / 1000.0;
+		if (span.bytes > 0) {
+			file << ", \"args\": {\"bytes\": " << span.bytes << "}";
+		}
+		file << "}";
+	}
+
+	file << endl << "]}" << endl;
+	return (bool)file;
+}
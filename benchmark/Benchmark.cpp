@@ -0,0 +1,346 @@
+/*
+Description
+- Benchmarks each kernel of kernels/my_kernels.cl in isolation, without the interactive pipeline.
+- The inputs are synthetic images with a uniform, Gaussian, single-spike or ramp distribution, since the skew of the data decides how much the atomic histograms contend.
+- The histogram and look-up table kernels are given the histogram of the same image, so their inputs are as realistic as those of the back-projections.
+- Each kernel is run many times after a warm-up run, and the mean throughput is reported with a 95% confidence interval.
+- The tiled histogram and back-projection kernels are timed for every row tile given, and on devices with 16-bit single-channel images so are the kernels of the image pipeline, so they can be compared with the one-dimensional kernels of the same stages.
+- The persistent histogram and back-projection kernels are timed for every number of work groups per compute unit given, against the kernels with one work item per pixel, at every image size.
+- The kernels can also be timed from a program built with the bin count and bit depth fixed at compile time, next to the generic program.
+*/
+
+#include <functional>
+#include <iomanip>
+
+#include "../include/HistogramEqualiser.h"
+
+void printHelp() {
+	std::cerr << "Application usage:" << std::endl;
+	std::cerr << "  -p : select platform (Default: 0)" << std::endl;
+	std::cerr << "  -d : select device (Default: 0)" << std::endl;
+	std::cerr << "  -l : list all platforms and devices" << std::endl;
+	std::cerr << "  -k : comma-separated kernels to benchmark (Default: all)" << std::endl;
+	std::cerr << "  -x : comma-separated distributions from uniform, gaussian, spike and ramp (Default: all)" << std::endl;
+	std::cerr << "  -s : comma-separated image sizes as WIDTHxHEIGHT (Default: 1024x1024)" << std::endl;
+	std::cerr << "  -n : repetitions of each kernel (Default: 30)" << std::endl;
+	std::cerr << "  -b : bin count (Default: 256)" << std::endl;
+	std::cerr << "  -w : bit depth of the synthetic images, 8 or 16 (Default: 8)" << std::endl;
+	std::cerr << "  -o : also write the results to a CSV file" << std::endl;
+	std::cerr << "  -u : also time every kernel built with the bin count and bit depth fixed at compile time" << std::endl;
+	std::cerr << "  -g : comma-separated row tiles of the tiled and image kernels as WxHxN, where each work item covers N pixels (Default: 16x16x1)" << std::endl;
+	std::cerr << "  -q : comma-separated work groups per compute unit of the persistent kernels (Default: 4)" << std::endl;
+	std::cerr << "  -h : print this message" << std::endl;
+}
+
+// Split a comma-separated list
+vector<string> splitList(const string& list) {
+	vector<string> items;
+	stringstream stream(list);
+	string item;
+	while (getline(stream, item, ',')) {
+		if (!item.empty()) {
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+// The two-sided 95% quantile of Student's t-distribution for the degrees of freedom
+double studentT95(int degrees) {
+	static const double quantiles[] = { 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131,
+		2.120, 2.110, 2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+	return (degrees >= 1 && degrees <= 30) ? quantiles[degrees - 1] : 1.960;
+}
+
+// A kernel with the arguments and range of one benchmark, and the number of items it processes
+struct BenchmarkKernel {
+	string name;
+	function<void(cl::Kernel&)> setArgs;
+	cl::NDRange global;
+	cl::NDRange local;
+	size_t items;
+	string unit;
+
+	// Restores the buffers before every run, for kernels that accumulate into their output or scan in place
+	function<void()> reset;
+
+	// The row tile and pixels per work item of the tiled and image kernels as given with -g, or the work groups per compute unit of the persistent kernels
+	string launch = "1D";
+};
+
+int main(int argc, char** argv) {
+	int platformID = 0;
+	int deviceID = 0;
+	vector<string> kernelNames;
+	vector<string> distributions = { "uniform", "gaussian", "spike", "ramp" };
+	vector<string> sizes = { "1024x1024" };
+	int repetitions = 30;
+	int binCount = 256;
+	int bitDepth = 8;
+	string csvFile;
+	bool specialised = false;
+	vector<string> tileShapes = { "16x16x1" };
+	vector<string> groupCounts = { "4" };
+
+	for (int i = 1; i < argc; i++) {
+		if ((strcmp(argv[i], "-p") == 0) && (i < (argc - 1))) { platformID = atoi(argv[++i]); }
+		else if ((strcmp(argv[i], "-d") == 0) && (i < (argc - 1))) { deviceID = atoi(argv[++i]); }
+		else if (strcmp(argv[i], "-l") == 0) { std::cout << ListPlatformsDevices() << std::endl; }
+		else if ((strcmp(argv[i], "-k") == 0) && (i < (argc - 1))) { kernelNames = splitList(argv[++i]); }
+		else if ((strcmp(argv[i], "-x") == 0) && (i < (argc - 1))) { distributions = splitList(argv[++i]); }
+		else if ((strcmp(argv[i], "-s") == 0) && (i < (argc - 1))) { sizes = splitList(argv[++i]); }
+		else if ((strcmp(argv[i], "-n") == 0) && (i < (argc - 1))) { repetitions = atoi(argv[++i]); }
+		else if ((strcmp(argv[i], "-b") == 0) && (i < (argc - 1))) { binCount = atoi(argv[++i]); }
+		else if ((strcmp(argv[i], "-w") == 0) && (i < (argc - 1))) { bitDepth = atoi(argv[++i]); }
+		else if ((strcmp(argv[i], "-o") == 0) && (i < (argc - 1))) { csvFile = argv[++i]; }
+		else if (strcmp(argv[i], "-u") == 0) { specialised = true; }
+		else if ((strcmp(argv[i], "-g") == 0) && (i < (argc - 1))) { tileShapes = splitList(argv[++i]); }
+		else if ((strcmp(argv[i], "-q") == 0) && (i < (argc - 1))) { groupCounts = splitList(argv[++i]); }
+		else if (strcmp(argv[i], "-h") == 0) { printHelp(); return 0; }
+	}
+
+	int maxIntensity = (bitDepth == 16) ? 65535 : 255;
+	if (binCount < 1 || binCount > 256 || repetitions < 2 || (bitDepth != 8 && bitDepth != 16)) {
+		std::cerr << "ERROR: the bin count must be between 1 and 256, the repetitions at least 2 and the bit depth 8 or 16" << std::endl;
+		printHelp();
+		return 1;
+	}
+
+	try {
+		cl::Context context = GetContext(platformID, deviceID);
+		cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+		cl::Program program = HistogramEqualiser::buildProgram(context, "kernels/my_kernels.cl");
+
+		// Time each kernel from the generic program, and from the program specialised for the bin count and bit depth when it is requested
+		vector<pair<string, cl::Program>> builds = { { "generic", program } };
+		if (specialised) {
+			builds.push_back({ "specialised", HistogramEqualiser::buildProgram(context, "kernels/my_kernels.cl", HistogramEqualiser::specialisationOptions(binCount, maxIntensity)) });
+		}
+		cl::CommandQueue queue(context, device, CL_QUEUE_PROFILING_ENABLE);
+		bool doublePrecision = device.getInfo<CL_DEVICE_EXTENSIONS>().find("cl_khr_fp64") != string::npos;
+		bool imageSupport = HistogramEqualiser::supportsIntensityImages(context, device);
+		cl::Image2D inputImage, outputImage;
+
+		// The row tiles of the tiled and image kernels, fitted to the work groups of the device
+		vector<pair<cl::NDRange, int>> tiles;
+		for (const string& shape : tileShapes) {
+			int tileWidth = 0, tileHeight = 0, itemsPerThread = 1;
+			if (sscanf(shape.c_str(), "%dx%dx%d", &tileWidth, &tileHeight, &itemsPerThread) < 2 || tileWidth < 1 || tileHeight < 1 || itemsPerThread < 1) {
+				std::cerr << "ERROR: invalid tile shape " << shape << std::endl;
+				return 1;
+			}
+			tiles.push_back({ HistogramEqualiser::launchTile(device, tileWidth, tileHeight), itemsPerThread });
+		}
+		for (const string& groups : groupCounts) {
+			if (atoi(groups.c_str()) < 1) {
+				std::cerr << "ERROR: invalid work groups per compute unit " << groups << std::endl;
+				return 1;
+			}
+		}
+
+		std::cout << "Running on " << GetPlatformName(platformID) << ", " << GetDeviceName(platformID, deviceID) << std::endl;
+		std::cout << repetitions << " repetitions, " << binCount << " bins, " << bitDepth << "-bit" << std::endl << std::endl;
+
+		ofstream csv;
+		if (!csvFile.empty()) {
+			csv.open(csvFile);
+			csv << "kernel,build,launch,distribution,width,height,items,unit,meanNs,meanNsCI95,itemsPerSecond,itemsPerSecondCI95" << std::endl;
+		}
+
+		std::cout << left << setw(26) << "Kernel" << setw(13) << "Build" << setw(10) << "Launch" << setw(10) << "Data" << setw(12) << "Size" << right << setw(12) << "Mean [us]" << setw(10) << "+/- [us]"
+			<< setw(18) << "Throughput [M/s]" << setw(10) << "+/- [M/s]" << "  Unit" << std::endl;
+
+		int increments = (maxIntensity + 1) / binCount;
+		mt19937 generator(12345);
+
+		for (const string& size : sizes) {
+			int width = 0, height = 0;
+			if (sscanf(size.c_str(), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+				std::cerr << "ERROR: invalid size " << size << std::endl;
+				return 1;
+			}
+			int pixelCount = width * height;
+
+			for (const string& distribution : distributions) {
+				// Generate three planes, so that the RGB and colour space kernels have an image too
+				vector<unsigned short> image(3 * (size_t)pixelCount);
+				for (int channel = 0; channel < 3; channel++) {
+					GenerateSyntheticPlane(image, channel * (size_t)pixelCount, pixelCount, distribution, maxIntensity, generator);
+				}
+
+				// Build the histograms, cumulative histograms and look-up tables of the planes on the host
+				vector<int> histogram(3 * binCount, 0), cumulative(3 * binCount), lut(3 * binCount), binValues(binCount + 1);
+				for (int channel = 0; channel < 3; channel++) {
+					for (int i = 0; i < pixelCount; i++) {
+						histogram[channel * binCount + min(image[channel * (size_t)pixelCount + i] / increments, binCount - 1)]++;
+					}
+					int total = 0;
+					for (int bin = 0; bin < binCount; bin++) {
+						total += histogram[channel * binCount + bin];
+						cumulative[channel * binCount + bin] = total;
+						lut[channel * binCount + bin] = (int)((long long)total * maxIntensity / pixelCount);
+					}
+				}
+				for (int bin = 0; bin < binCount; bin++) {
+					binValues[bin] = bin * increments;
+				}
+				binValues[binCount] = maxIntensity + 1;
+
+				size_t imageBytes = image.size() * sizeof(unsigned short);
+				size_t histoBytes = histogram.size() * sizeof(int);
+				cl::Buffer imageBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, imageBytes, image.data());
+				cl::Buffer outputBuffer(context, CL_MEM_READ_WRITE, imageBytes);
+				cl::Buffer chromaBuffer(context, CL_MEM_READ_WRITE, 2 * (size_t)pixelCount * sizeof(float));
+				cl::Buffer histogramBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, histoBytes, histogram.data());
+				cl::Buffer cumulativeBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, histoBytes, cumulative.data());
+				cl::Buffer lutBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, histoBytes, lut.data());
+				cl::Buffer binBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, binValues.size() * sizeof(int), binValues.data());
+				cl::Buffer scanBuffer(context, CL_MEM_READ_WRITE, histoBytes);
+				cl::Buffer scratchBuffer(context, CL_MEM_READ_WRITE, histoBytes);
+
+				// Clear the histogram output, and restore the histogram that the scans overwrite
+				auto clearScratch = [&]() { queue.enqueueFillBuffer(scratchBuffer, 0, 0, histoBytes); };
+				auto restoreScan = [&]() { queue.enqueueCopyBuffer(histogramBuffer, scanBuffer, 0, 0, histoBytes); clearScratch(); };
+
+				// The fixed-point reciprocal of the last cumulative value for the fixed-point look-up table, which is the pixel count of the inclusive host scan
+				cl_ulong reciprocal;
+				int shift1, shift2;
+				GetFixedPointReciprocal((cl_uint)pixelCount, reciprocal, shift1, shift2);
+
+				// The per-channel histogram runs in full work groups of up to 256 items
+				size_t groupSize = min((size_t)256, device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>());
+				cl::NDRange roundedPixels(((pixelCount + groupSize - 1) / groupSize) * groupSize);
+
+				// The kernels with their arguments, set as the pipeline sets them
+				vector<BenchmarkKernel> benchmarks = {
+					{ "intHistogram", [&](cl::Kernel& k) { k.setArg(0, imageBuffer); k.setArg(1, scratchBuffer); }, cl::NDRange(pixelCount), cl::NullRange, (size_t)pixelCount, "pixels", clearScratch },
+					{ "intHistogram2", [&](cl::Kernel& k) { k.setArg(0, imageBuffer); k.setArg(1, scratchBuffer); k.setArg(2, binCount); k.setArg(3, increments); }, cl::NDRange(pixelCount), cl::NullRange, (size_t)pixelCount, "pixels", clearScratch },
+					{ "intHistogram3", [&](cl::Kernel& k) { k.setArg(0, imageBuffer); k.setArg(1, scratchBuffer); k.setArg(2, pixelCount); k.setArg(3, binCount); k.setArg(4, binBuffer); k.setArg(5, cl::Local(binCount * sizeof(int))); }, cl::NDRange(pixelCount), cl::NullRange, (size_t)pixelCount, "pixels", clearScratch },
+					{ "intHistogramRGB", [&](cl::Kernel& k) { k.setArg(0, imageBuffer); k.setArg(1, scratchBuffer); k.setArg(2, pixelCount); k.setArg(3, binCount); k.setArg(4, increments); k.setArg(5, cl::Local(histoBytes)); }, roundedPixels, cl::NDRange(groupSize), 3 * (size_t)pixelCount, "values", clearScratch },
+					{ "cumHistogram", [&](cl::Kernel& k) { k.setArg(0, scanBuffer); k.setArg(1, scratchBuffer); }, cl::NDRange(binCount), cl::NDRange(binCount), (size_t)binCount, "bins", restoreScan },
+					{ "cumHistogramB", [&](cl::Kernel& k) { k.setArg(0, scanBuffer); k.setArg(1, scratchBuffer); }, cl::NDRange(binCount), cl::NDRange(binCount), (size_t)binCount, "bins", restoreScan },
+					{ "cumHistogramHS", [&](cl::Kernel& k) { k.setArg(0, scanBuffer); k.setArg(1, scratchBuffer); }, cl::NDRange(binCount), cl::NDRange(binCount), (size_t)binCount, "bins", restoreScan },
+					{ "cumHistogramHS2", [&](cl::Kernel& k) { k.setArg(0, scanBuffer); k.setArg(1, scratchBuffer); k.setArg(2, cl::Local(binCount * sizeof(int))); k.setArg(3, cl::Local(binCount * sizeof(int))); }, cl::NDRange(binCount), cl::NDRange(binCount), (size_t)binCount, "bins", restoreScan },
+					{ "cumHistogramLUT", [&](cl::Kernel& k) { k.setArg(0, scanBuffer); k.setArg(1, scratchBuffer); k.setArg(2, outputBuffer); k.setArg(3, maxIntensity); k.setArg(4, cl::Local(binCount * sizeof(int))); k.setArg(5, cl::Local(binCount * sizeof(int))); }, cl::NDRange(binCount), cl::NDRange(binCount), (size_t)binCount, "bins", restoreScan },
+					{ "lookupTable", [&](cl::Kernel& k) { k.setArg(0, cumulativeBuffer); k.setArg(1, scratchBuffer); k.setArg(2, maxIntensity); }, cl::NDRange(binCount), cl::NullRange, (size_t)binCount, "bins", nullptr },
+					{ "lookupTable2", [&](cl::Kernel& k) { k.setArg(0, cumulativeBuffer); k.setArg(1, scratchBuffer); k.setArg(2, maxIntensity); k.setArg(3, binCount); }, cl::NDRange(binCount), cl::NullRange, (size_t)binCount, "bins", nullptr },
+					{ "lookupTable3", [&](cl::Kernel& k) { k.setArg(0, cumulativeBuffer); k.setArg(1, scratchBuffer); k.setArg(2, maxIntensity); k.setArg(3, binCount); }, cl::NDRange(binCount), cl::NullRange, (size_t)binCount, "bins", nullptr },
+					{ "lookupTable4", [&](cl::Kernel& k) { k.setArg(0, cumulativeBuffer); k.setArg(1, scratchBuffer); k.setArg(2, maxIntensity); k.setArg(3, reciprocal); k.setArg(4, shift1); k.setArg(5, shift2); }, cl::NDRange(binCount), cl::NullRange, (size_t)binCount, "bins", nullptr },
+					{ "histogramMatch", [&](cl::Kernel& k) { k.setArg(0, cumulativeBuffer); k.setArg(1, cumulativeBuffer); k.setArg(2, scratchBuffer); k.setArg(3, binCount); k.setArg(4, increments); k.setArg(5, maxIntensity); }, cl::NDRange(binCount), cl::NullRange, (size_t)binCount, "bins", nullptr },
+					{ "backprojection", [&](cl::Kernel& k) { k.setArg(0, imageBuffer); k.setArg(1, lutBuffer); k.setArg(2, outputBuffer); }, cl::NDRange(pixelCount), cl::NullRange, (size_t)pixelCount, "pixels", nullptr },
+					{ "backprojection2", [&](cl::Kernel& k) { k.setArg(0, imageBuffer); k.setArg(1, lutBuffer); k.setArg(2, outputBuffer); k.setArg(3, binCount); k.setArg(4, binBuffer); }, cl::NDRange(pixelCount), cl::NullRange, (size_t)pixelCount, "pixels", nullptr },
+					{ "backprojection3", [&](cl::Kernel& k) { k.setArg(0, imageBuffer); k.setArg(1, lutBuffer); k.setArg(2, outputBuffer); k.setArg(3, binCount); k.setArg(4, binBuffer); }, cl::NDRange(pixelCount), cl::NullRange, (size_t)pixelCount, "pixels", nullptr },
+					{ "backprojectionRGB", [&](cl::Kernel& k) { k.setArg(0, imageBuffer); k.setArg(1, lutBuffer); k.setArg(2, outputBuffer); k.setArg(3, pixelCount); k.setArg(4, binCount); k.setArg(5, increments); }, cl::NDRange(pixelCount), cl::NullRange, (size_t)pixelCount, "pixels", nullptr },
+				};
+
+				// The tiled kernels run over the first plane as a 2D image of row tiles, rounded up to cover the image, once for every tile shape
+				// The image kernels read the same plane from an image and write the back-projection to another, and are only timed on devices with 16-bit single-channel images
+				if (imageSupport) {
+					cl::ImageFormat format(CL_R, CL_UNSIGNED_INT16);
+					inputImage = cl::Image2D(context, CL_MEM_READ_ONLY, format, width, height);
+					outputImage = cl::Image2D(context, CL_MEM_WRITE_ONLY, format, width, height);
+					queue.enqueueWriteImage(inputImage, CL_TRUE, { 0, 0, 0 }, { (size_t)width, (size_t)height, 1 }, 0, 0, image.data());
+				}
+				for (size_t shape = 0; shape < tiles.size(); shape++) {
+					cl::NDRange tile = tiles[shape].first;
+					int itemsPerThread = tiles[shape].second;
+					cl::NDRange tiledGlobal = HistogramEqualiser::tiledRange(width, height, tile, itemsPerThread);
+					string launch = to_string(tile[0]) + "x" + to_string(tile[1]) + "x" + to_string(itemsPerThread);
+
+					benchmarks.push_back({ "intHistogram2D", [&, itemsPerThread](cl::Kernel& k) { k.setArg(0, imageBuffer); k.setArg(1, scratchBuffer); k.setArg(2, width); k.setArg(3, height); k.setArg(4, binCount); k.setArg(5, increments); k.setArg(6, itemsPerThread); k.setArg(7, cl::Local(binCount * sizeof(int))); }, tiledGlobal, tile, (size_t)pixelCount, "pixels", clearScratch, launch });
+					benchmarks.push_back({ "backprojection2D", [&, itemsPerThread](cl::Kernel& k) { k.setArg(0, imageBuffer); k.setArg(1, lutBuffer); k.setArg(2, outputBuffer); k.setArg(3, width); k.setArg(4, height); k.setArg(5, binCount); k.setArg(6, increments); k.setArg(7, itemsPerThread); }, tiledGlobal, tile, (size_t)pixelCount, "pixels", nullptr, launch });
+					if (imageSupport) {
+						benchmarks.push_back({ "intHistogramImage", [&, itemsPerThread](cl::Kernel& k) { k.setArg(0, inputImage); k.setArg(1, scratchBuffer); k.setArg(2, binCount); k.setArg(3, increments); k.setArg(4, itemsPerThread); k.setArg(5, cl::Local(binCount * sizeof(int))); }, tiledGlobal, tile, (size_t)pixelCount, "pixels", clearScratch, launch });
+						benchmarks.push_back({ "backprojectionImage", [&, itemsPerThread](cl::Kernel& k) { k.setArg(0, inputImage); k.setArg(1, lutBuffer); k.setArg(2, outputImage); k.setArg(3, binCount); k.setArg(4, increments); k.setArg(5, itemsPerThread); }, tiledGlobal, tile, (size_t)pixelCount, "pixels", nullptr, launch });
+					}
+				}
+
+				// The persistent kernels launch the given number of work groups per compute unit, which stride over the first plane
+				for (const string& groups : groupCounts) {
+					cl::NDRange persistentGlobal = HistogramEqualiser::persistentRange(device, atoi(groups.c_str()), pixelCount);
+					cl::NDRange persistentLocal = HistogramEqualiser::persistentGroup(device);
+					string launch = groups + "/CU";
+
+					benchmarks.push_back({ "intHistogramPersistent", [&](cl::Kernel& k) { k.setArg(0, imageBuffer); k.setArg(1, scratchBuffer); k.setArg(2, pixelCount); k.setArg(3, binCount); k.setArg(4, increments); k.setArg(5, cl::Local(binCount * sizeof(int))); }, persistentGlobal, persistentLocal, (size_t)pixelCount, "pixels", clearScratch, launch });
+					benchmarks.push_back({ "backprojectionPersistent", [&](cl::Kernel& k) { k.setArg(0, imageBuffer); k.setArg(1, lutBuffer); k.setArg(2, outputBuffer); k.setArg(3, pixelCount); k.setArg(4, binCount); k.setArg(5, increments); }, persistentGlobal, persistentLocal, (size_t)pixelCount, "pixels", nullptr, launch });
+				}
+
+				// The colour space conversions share their arguments
+				for (const char* name : { "rgbToHSV", "rgbToHSL", "rgbToLab" }) {
+					benchmarks.push_back({ name, [&](cl::Kernel& k) { k.setArg(0, imageBuffer); k.setArg(1, outputBuffer); k.setArg(2, chromaBuffer); k.setArg(3, pixelCount); k.setArg(4, maxIntensity); }, cl::NDRange(pixelCount), cl::NullRange, (size_t)pixelCount, "pixels", nullptr });
+				}
+				for (const char* name : { "hsvToRGB", "hslToRGB", "labToRGB" }) {
+					benchmarks.push_back({ name, [&](cl::Kernel& k) { k.setArg(0, imageBuffer); k.setArg(1, chromaBuffer); k.setArg(2, outputBuffer); k.setArg(3, pixelCount); k.setArg(4, maxIntensity); }, cl::NDRange(pixelCount), cl::NullRange, (size_t)pixelCount, "pixels", nullptr });
+				}
+
+				for (BenchmarkKernel& benchmark : benchmarks) {
+					if (!kernelNames.empty() && find(kernelNames.begin(), kernelNames.end(), benchmark.name) == kernelNames.end()) {
+						continue;
+					}
+
+					// Skip the kernels that cannot run with these settings rather than reading out of bounds
+					bool rawIndex = (benchmark.name == "intHistogram" || benchmark.name == "backprojection" || benchmark.name == "lookupTable");
+					bool doubleOnly = (benchmark.name == "lookupTable" || benchmark.name == "lookupTable2" || benchmark.name == "lookupTable3");
+					if ((rawIndex && binCount != maxIntensity + 1) || (doubleOnly && !doublePrecision)) {
+						continue;
+					}
+
+					for (const pair<string, cl::Program>& build : builds) {
+						cl::Kernel kernel(build.second, benchmark.name.c_str());
+						benchmark.setArgs(kernel);
+
+						// Time every run after a warm-up run, which also builds any lazily compiled code
+						vector<double> times;
+						for (int run = 0; run <= repetitions; run++) {
+							if (benchmark.reset) {
+								benchmark.reset();
+							}
+							cl::Event event;
+							queue.enqueueNDRangeKernel(kernel, cl::NullRange, benchmark.global, benchmark.local, NULL, &event);
+							event.wait();
+							if (run > 0) {
+								times.push_back((double)(event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>()));
+							}
+						}
+
+						// The mean time and the mean throughput of the runs, each with the half-width of its 95% confidence interval
+						double meanTime = 0.0, meanRate = 0.0;
+						vector<double> rates;
+						for (double time : times) {
+							rates.push_back(benchmark.items * 1e3 / max(time, 1.0));
+							meanTime += time / times.size();
+							meanRate += rates.back() / times.size();
+						}
+						double timeVariance = 0.0, rateVariance = 0.0;
+						for (size_t i = 0; i < times.size(); i++) {
+							timeVariance += (times[i] - meanTime) * (times[i] - meanTime) / (times.size() - 1);
+							rateVariance += (rates[i] - meanRate) * (rates[i] - meanRate) / (rates.size() - 1);
+						}
+						double t = studentT95((int)times.size() - 1);
+						double timeError = t * sqrt(timeVariance / times.size());
+						double rateError = t * sqrt(rateVariance / rates.size());
+
+						std::cout << left << setw(26) << benchmark.name << setw(13) << build.first << setw(10) << benchmark.launch << setw(10) << distribution << setw(12) << size << right << fixed << setprecision(2)
+							<< setw(12) << meanTime / 1e3 << setw(10) << timeError / 1e3 << setw(18) << meanRate << setw(10) << rateError << "  " << benchmark.unit << std::endl;
+
+						if (csv.is_open()) {
+							csv << benchmark.name << "," << build.first << "," << benchmark.launch << "," << distribution << "," << width << "," << height << "," << benchmark.items << "," << benchmark.unit << ","
+								<< meanTime << "," << timeError << "," << meanRate * 1e6 << "," << rateError * 1e6 << std::endl;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	catch (const cl::Error& err) {
+		std::cerr << "ERROR: " << err.what() << ", " << getErrorString(err.err()) << std::endl;
+		return 1;
+	}
+	catch (const invalid_argument& err) {
+		std::cerr << "ERROR: " << err.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,12 @@
+# Write a file into a header as an array of bytes with its size, which avoids the length limits of string literals and allows binary files
+# The array is also null-terminated, so that kernel source can be read as a string
+# Usage: cmake -DINPUT=kernels/my_kernels.cl -DOUTPUT=EmbeddedKernels.h -DNAME=embeddedKernelSource -P EmbedKernels.cmake
+
+file(READ ${INPUT} bytes HEX)
+string(LENGTH "${bytes}" size)
+math(EXPR size "${size} / 2")
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${bytes}")
+string(REGEX REPLACE "(0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,)" "\\1\n\t" bytes "${bytes}")
+get_filename_component(fileName ${INPUT} NAME)
+
+file(WRITE ${OUTPUT} "#pragma once\n\n#include <cstddef>\n\n// Generated from ${fileName} at build time, do not edit\nstatic const unsigned char ${NAME}[] = {\n\t${bytes}0x00\n};\nstatic const size_t ${NAME}Size = ${size};\n")
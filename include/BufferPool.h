@@ -0,0 +1,46 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "Utils.h"
+
+// The buffer requests a pool has served, counting a request as a hit when it needed no new allocation
+struct BufferPoolStatistics {
+	cl_ulong requests = 0;
+	cl_ulong hits = 0;
+	cl_ulong allocations = 0;
+
+	// The bytes of every buffer allocated, and of the buffers waiting in the pool
+	size_t allocatedBytes = 0;
+	size_t freeBytes = 0;
+
+	double hitRate() const { return requests > 0 ? (double)hits / requests : 0.0; }
+};
+
+// Device buffers recycled by size class, so that images of varying sizes reuse earlier allocations instead of allocating new buffers
+// Sizes are rounded up to a power of two of at least 4 KB, and a buffer returned to the pool is kept until the pool is destroyed
+// The pool is thread-safe, so the equalisers sharing a context can share one pool
+class BufferPool {
+public:
+	explicit BufferPool(const cl::Context& context) : context(context) {}
+
+	// Make a buffer hold at least the size, keeping it while the size falls in its size class and otherwise returning it to the pool for one of the right class
+	// The capacity is the size class of the buffer, or 0 when it has none yet, and true is returned when a new buffer had to be allocated
+	bool reserve(cl::Buffer& buffer, size_t& capacity, size_t size);
+
+	// The size class that a request of the size is served from
+	static size_t sizeClass(size_t size);
+
+	BufferPoolStatistics getStatistics() const;
+
+private:
+	cl::Context context;
+	mutable mutex poolMutex;
+
+	// The free buffers of each size class
+	map<size_t, vector<cl::Buffer>> freeBuffers;
+
+	BufferPoolStatistics statistics;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "HistogramEqualiser.h"
+
+// One image to equalise, whose input and output must stay valid until the request has completed
+struct EqualiseRequest {
+	const uint16_t* in;
+	uint16_t* out;
+	int width;
+	int height;
+	int channels;
+	EqualiserOptions options;
+};
+
+// The worker that served a request and how long it waited and ran, in nanoseconds
+struct EqualiseResponse {
+	int worker;
+	cl_ulong queuedTime;
+	cl_ulong serviceTime;
+};
+
+// A histogram of latencies in power-of-two buckets of nanoseconds
+class LatencyHistogram {
+public:
+	void record(cl_ulong latency);
+
+	// The upper bound of the bucket holding the given fraction of the recorded latencies
+	cl_ulong percentile(double fraction) const;
+
+	cl_ulong getCount() const { return count; }
+
+	// Print the non-empty buckets with their counts
+	void print(ostream& out) const;
+
+private:
+	cl_ulong buckets[64] = {};
+	cl_ulong count = 0;
+};
+
+// Serves equalisation requests from many threads through a pool of workers, each with its own command queue, kernels and buffers
+// The workers share one context and program, and the bounded request queue blocks submissions when it is full
+class EqualiserServer {
+public:
+	EqualiserServer(int platformID, int deviceID, int workerCount, size_t queueCapacity = 64, const string& kernelFile = "kernels/my_kernels.cl");
+
+	// Stop accepting requests, finish the queued ones and join the workers
+	~EqualiserServer();
+
+	// Queue a request, waiting while the queue is full
+	future<EqualiseResponse> submit(const EqualiseRequest& request);
+
+	// Queue a request only when there is space, so that the caller can shed load instead of waiting
+	bool trySubmit(const EqualiseRequest& request, future<EqualiseResponse>& response);
+
+	// Print the latency histograms, the throughput since the first request and the hit rates of the shared pools
+	void printStatistics(ostream& out);
+
+	int getWorkerCount() const { return (int)workers.size(); }
+
+private:
+	struct Job {
+		EqualiseRequest request;
+		promise<EqualiseResponse> response;
+		chrono::steady_clock::time_point submitted;
+	};
+
+	// Take jobs from the queue until the server stops
+	void work(int worker);
+
+	// Add a job to the queue and wake a worker, with the lock already held
+	future<EqualiseResponse> push(const EqualiseRequest& request);
+
+	cl::Context context;
+	cl::Program program;
+	shared_ptr<BufferPool> pool;
+	shared_ptr<PinnedHostPool> hostPool;
+	vector<unique_ptr<HistogramEqualiser>> equalisers;
+	vector<thread> workers;
+
+	// The bounded request queue and its signals for the workers and the waiting submitters
+	mutex queueMutex;
+	condition_variable notEmpty;
+	condition_variable notFull;
+	deque<Job> jobs;
+	size_t queueCapacity;
+	bool stopping = false;
+
+	// The statistics of completed requests
+	mutex statisticsMutex;
+	LatencyHistogram queuedLatency;
+	LatencyHistogram serviceLatency;
+	LatencyHistogram totalLatency;
+	cl_ulong pixelsServed = 0;
+	cl_ulong requestsFailed = 0;
+	bool started = false;
+	chrono::steady_clock::time_point firstSubmitted;
+	chrono::steady_clock::time_point lastCompleted;
+};
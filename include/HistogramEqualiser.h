@@ -0,0 +1,287 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BufferPool.h"
+#include "KernelRegistry.h"
+#include "PinnedHostPool.h"
+#include "Utils.h"
+
+#include "CImg.h"
+
+// The kernels and parameters of one equalisation, with the kernel choices numbered as in the menus of the command line program
+struct EqualiserOptions {
+	// The number of bins in the histogram, between 1 and 256
+	int binCount = 256;
+
+	// The intensity histogram: 1) standardised, 2) variable, 3) local memory, 4) per-channel RGB
+	// The standardised histogram needs a bin for every intensity level, and is replaced by the variable implementation otherwise
+	int intHistoChoice = 2;
+
+	// The cumulative histogram: 1) serial, 2) Blelloch, 3) Hillis-Steele, 4) double buffered Hillis-Steele, 5) with the normalised look-up table
+	// The serial and Blelloch scans are exclusive, so histogram matching replaces them with the double buffered Hillis-Steele scan
+	// The Blelloch scan needs a power of two bins, and is replaced by the serial scan otherwise
+	int cumHistoChoice = 5;
+
+	// The look-up table: 1) standardised, 2) variable, 3) local memory, 4) fixed-point, which is skipped when the cumulative histogram writes it
+	// Every table divides by the last cumulative value, so the fixed-point table that replaces the others without fp64 gives the same image
+	// The standardised look-up table needs a bin for every intensity level, and is replaced by the variable implementation otherwise
+	int lookupChoice = 4;
+
+	// The back-projection: 1) standardised, 2) variable, 3) binary search, 4) per-channel RGB
+	// The standardised back-projection needs a bin for every intensity level, and is replaced by the variable implementation otherwise
+	int backprojectChoice = 1;
+
+	// The colour mode for RGB images: ycbcr, rgb, hsv, hsl or lab
+	string colourMode = "ycbcr";
+
+	// The largest intensity of the image, 255 for 8-bit and 65535 for 16-bit
+	int maxIntensity = 255;
+
+	// The target cumulative histogram, which replaces the look-up table with histogram matching when it is not empty
+	vector<int> targetCDF;
+
+	// Run the kernels from a program built with the bin count and bit depth fixed at compile time, which is built once for each configuration
+	bool specialise = false;
+
+	// Upload a single intensity plane as an image and run the histogram and back-projection on it in 2D tiles, writing the output to an image
+	// This replaces the intensity histogram and back-projection choices, and is ignored on devices without support for 16-bit single-channel images, for RGB images in the per-channel or device colour modes, and by the band stages
+	bool imagePipeline = false;
+
+	// Run the histogram and back-projection over a 2D range of row tiles instead of one work item per value, bounds checked so that any image size fits
+	// This replaces the intensity histogram and back-projection choices, except in the per-channel mode, the image pipeline and the band stages
+	bool tiledLaunch = false;
+
+	// The width and height of the row tiles in work items, which shrink to fit the work groups of the device, and the pixels each work item covers along its row
+	// The image pipeline launches over the same tiles
+	int tileWidth = 16;
+	int tileHeight = 16;
+	int itemsPerThread = 1;
+
+	// Run the histogram and back-projection as a fixed number of work groups per compute unit of the device, each work item looping over the image with a grid stride
+	// This replaces the intensity histogram and back-projection choices in the same cases as the tiled launch, which takes precedence along with the image pipeline
+	bool persistentLaunch = false;
+	int groupsPerComputeUnit = 4;
+};
+
+// A buffer write, read or fill of an equalisation, with the bytes it moved and whether the host side was pinned memory
+struct EqualiserTransfer {
+	string stage;
+	string command;
+	size_t bytes;
+	bool pinned;
+	cl::Event event;
+};
+
+// A step of an equalisation that runs on the host
+struct EqualiserSpan {
+	string name;
+	chrono::steady_clock::time_point start;
+	chrono::steady_clock::time_point end;
+};
+
+// The histograms, kernel names and events of the last equalisation
+struct EqualiserResult {
+	// The intensity histogram, cumulative histogram and look-up table, holding one set of bins per channel in the per-channel mode
+	vector<int> IH;
+	vector<int> CH;
+	vector<int> LUT;
+
+	// The kernel used by each stage, where the colour conversions are empty when they were not used
+	string colourToFunction;
+	string intHistoFunction;
+	string cumHistoFunction;
+	string lookupFunction;
+	string backprojectFunction;
+	string colourFromFunction;
+
+	// The profiling event of each stage, where the look-up table event is the cumulative histogram event when the two are fused
+	cl::Event colourToEvent;
+	cl::Event intHistoEvent;
+	cl::Event cumHistoEvent;
+	cl::Event lookupEvent;
+	cl::Event backprojectEvent;
+	cl::Event colourFromEvent;
+
+	// The profiled transfers between the host and the device, in the order they were queued
+	vector<EqualiserTransfer> transfers;
+
+	// The colour conversions done on the host
+	vector<EqualiserSpan> hostSpans;
+
+	// The device buffers requested from the buffer pool, and how many of them had to be allocated
+	int bufferRequests = 0;
+	int bufferAllocations = 0;
+};
+
+// Equalises images on one OpenCL device, keeping the compiled program, the kernels and the device buffers between calls
+// Buffers come from a pool by size class, so repeated calls with images of similar sizes allocate nothing on the device and only bind the kernel arguments that changed
+// The host side of the transfers can be pinned memory from a second pool, which the images are decoded into and read from
+// An instance is not thread-safe, but instances sharing one context and program can be used from separate threads
+class HistogramEqualiser {
+public:
+	// Create the context for the selected platform and device and build the kernel file
+	HistogramEqualiser(int platformID, int deviceID, const string& kernelFile = "kernels/my_kernels.cl");
+
+	// Share a context and a program built for the device, with a command queue of its own, and optionally a buffer pool and a pinned host pool of the context
+	HistogramEqualiser(const cl::Context& context, const cl::Program& program, const cl::Device& device, shared_ptr<BufferPool> pool = nullptr, shared_ptr<PinnedHostPool> hostPool = nullptr);
+
+	// Build the kernel file for every device of the context with the given build options, printing the build log when it fails
+	static cl::Program buildProgram(const cl::Context& context, const string& kernelFile, const string& buildOptions = "");
+
+	// The build options that fix the bin count, the maximum intensity and the bin width of the kernels at compile time
+	static string specialisationOptions(int binCount, int maxIntensity);
+
+	// Equalise an image of 1 or 3 channels stored one plane after another, writing an output of the same size
+	// The result is overwritten by the next call
+	const EqualiserResult& equalise(const uint16_t* in, uint16_t* out, int width, int height, int channels, const EqualiserOptions& options);
+
+	// The stages of one intensity plane split into bands of pixels, so that an image can be spread across devices
+	// Calculate the binned histogram of a band with the variable intensity histogram
+	void bandHistogram(const uint16_t* band, int pixelCount, const EqualiserOptions& options, vector<int>& histogram);
+
+	// Build the look-up table of a whole plane from its merged histogram, with the selected cumulative histogram and look-up table
+	const EqualiserResult& lookupTable(const vector<int>& histogram, const EqualiserOptions& options);
+
+	// Back-project a band through the look-up table with the selected back-projection, which must not be the per-channel one
+	void bandBackprojection(const uint16_t* band, uint16_t* out, int pixelCount, const vector<int>& lut, const EqualiserOptions& options);
+
+	// Build the cumulative histogram of a reference image for histogram matching, using the channel of the colour mode that the image is matched on when it is RGB
+	vector<int> targetCDF(const uint16_t* reference, int width, int height, int channels, const EqualiserOptions& options);
+
+	// Pinned host memory for the input and the output of an equalisation, holding at least the number of values
+	// An image decoded into the input and equalised into the output is transferred without a staging copy, and the memory is kept until it is requested again for a size of another class
+	uint16_t* stagingInput(size_t values);
+	uint16_t* stagingOutput(size_t values);
+
+	// Whether the double-precision look-up tables are available on the device
+	bool hasDoublePrecision() const { return doublePrecision; }
+
+	// Whether the device can read and write the 16-bit single-channel images of the image pipeline
+	bool hasImageSupport() const { return imageSupport; }
+
+	// Whether the device supports images and the context can both read and write images of one 16-bit unsigned channel
+	static bool supportsIntensityImages(const cl::Context& context, const cl::Device& device);
+
+	// The local range of a row tile of the given width and height, shortened and then narrowed until it fits the work groups of the device
+	static cl::NDRange launchTile(const cl::Device& device, int tileWidth, int tileHeight);
+
+	// The work group of the persistent kernels, and the global range of the given number of work groups per compute unit, no larger than needed to give every value a work item
+	static cl::NDRange persistentGroup(const cl::Device& device);
+	static cl::NDRange persistentRange(const cl::Device& device, int groupsPerComputeUnit, size_t values);
+
+	// The global range covering an image with row tiles, where each work item covers the given number of pixels, rounded up to whole tiles in both dimensions
+	static cl::NDRange tiledRange(int width, int height, const cl::NDRange& tile, int itemsPerThread);
+
+	// The number of device buffers allocated since the equaliser was created
+	int getAllocationCount() const { return allocationCount; }
+
+	// The kernels created by the equaliser and the arguments bound to them
+	const KernelRegistry& getKernels() const { return kernels; }
+
+	// The pool the device buffers come from, which may be shared with other equalisers
+	const BufferPool& getBufferPool() const { return *pool; }
+
+	// The pool the pinned host memory comes from, which may be shared with other equalisers
+	const PinnedHostPool& getHostPool() const { return *hostPool; }
+
+	const cl::Context& getContext() const { return context; }
+	const cl::Program& getProgram() const { return program; }
+	const cl::Device& getDevice() const { return device; }
+	cl::CommandQueue& getQueue() { return queue; }
+
+private:
+	// Select the program for the configuration of the options, building the specialised program the first time the configuration is seen
+	void useProgram(const EqualiserOptions& options);
+
+	// The intensity histogram choice of the options, falling back to the variable implementation without a bin for every intensity level
+	int selectHistogram(const EqualiserOptions& options) const;
+
+	// The cumulative histogram choice of the options, replacing the exclusive scans with an inclusive one for histogram matching and the Blelloch scan without a power of two bins
+	int selectScan(const EqualiserOptions& options) const;
+
+	// The back-projection choice of the options, falling back to the variable implementation without a bin for every intensity level
+	int selectBackprojection(const EqualiserOptions& options) const;
+
+	// The look-up table choice of the options, falling back to an implementation that can run with the bin count and on the device
+	int selectLookup(const EqualiserOptions& options) const;
+
+	// Return the cached kernel with the given name from the selected program, creating it on first use
+	CachedKernel& getKernel(const string& name);
+
+	// Scan the intensity histogram buffer and build the look-up table, reading the cumulative histogram and the look-up table into the result
+	void lookupStages(const EqualiserOptions& options, int cumHistoChoice, int lookupChoice, int channelCount);
+
+	// Back-project the input buffer into the output buffer through the look-up table buffer, or the input image into the output image in the image pipeline
+	// The tile and the items per work item are only used by the tiled and image back-projections, and the work groups per compute unit by the persistent back-projection
+	void backprojectStage(int backprojectChoice, int binCount, int increments, int width, int height, size_t intensitySize, const cl::NDRange& tile, int itemsPerThread, int groupsPerComputeUnit);
+
+	// Write an intensity plane from the host to the input buffer, or to the input image in the image pipeline, and read the output back in the same way
+	void writeIntensity(const uint16_t* plane, int width, int height, size_t values, bool imagePipeline);
+	void readIntensity(uint16_t* plane, int width, int height, size_t values, bool imagePipeline);
+
+	// Add a transfer to the result, returning the event for the command to fill in, where the host memory is given for the images as they are the transfers that can be pinned
+	cl::Event* transfer(const string& stage, const string& command, size_t bytes, const void* host = NULL);
+
+	// Whether the host memory lies in the pinned memory held by the equaliser
+	bool isPinned(const void* host, size_t bytes) const;
+
+	// Swap a device buffer through the pool when the requested size is outside its size class, counting the request in the result
+	void reserve(cl::Buffer& buffer, size_t& capacity, size_t size);
+
+	// Reserve the target cumulative histogram buffer, forgetting the target it holds when the buffer is swapped
+	void reserveTarget(size_t size);
+
+	// Fill the bin values with the lower bound of every bin and the end of the intensity range
+	void fillBinValues(int binCount, int maxIntensity);
+
+	// Create the input and output images when the image size changes, counting the request in the result
+	void reserveImages(int width, int height);
+
+	cl::Context context;
+	cl::Program program;
+	cl::Device device;
+	cl::CommandQueue queue;
+	bool doublePrecision;
+	bool imageSupport;
+
+	// The kernel file, which the specialised programs are built from
+	string kernelFile;
+
+	// The specialised programs built so far by their build options, and the build options of the selected program, which are empty for the generic program
+	map<string, cl::Program> specialisedPrograms;
+	string programOptions;
+
+	// The kernels created so far with the arguments bound to them, by the build options of their program and their name
+	KernelRegistry kernels;
+
+	// The pool of the device buffers, and the buffers with the size classes they were taken from in bytes
+	shared_ptr<BufferPool> pool;
+	cl::Buffer imgInputBuffer, imgOutputBuffer, colourBuffer, chromaBuffer;
+	cl::Buffer intHistoBuffer, cumHistoBuffer, lookupBuffer, histoSizeBuffer, targetCDFBuffer;
+	size_t imgInputCapacity = 0, imgOutputCapacity = 0, colourCapacity = 0, chromaCapacity = 0;
+	size_t intHistoCapacity = 0, cumHistoCapacity = 0, lookupCapacity = 0, histoSizeCapacity = 0, targetCDFCapacity = 0;
+	int allocationCount = 0;
+
+	// The target cumulative histogram held in the target buffer, so that it is only written when the target changes
+	vector<int> deviceTarget;
+
+	// The images of the image pipeline, which cannot be pooled by size class and so are only recreated when the image size changes
+	cl::Image2D imgInputImage, imgOutputImage;
+	int imageWidth = 0, imageHeight = 0;
+
+	// The pool of the pinned host memory, and the memory held for the input, the output and the YCbCr image
+	shared_ptr<PinnedHostPool> hostPool;
+	PinnedBuffer inputStaging, outputStaging, colourStaging;
+
+	// The host storage reused between calls for the bin values, and the YCbCr image, which shares the pinned memory held for it
+	vector<int> binValues;
+	cimg_library::CImg<unsigned short> imgYCbCr;
+
+	EqualiserResult result;
+};
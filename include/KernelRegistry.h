@@ -0,0 +1,90 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Utils.h"
+
+// A kernel that remembers the arguments bound to it, so that setting an argument to the value it already holds does not call into the runtime
+// It converts to the kernel it holds, so that it can be enqueued directly
+class CachedKernel {
+public:
+	explicit CachedKernel(const cl::Kernel& kernel) : kernel(kernel) {}
+
+	// Bind an argument unless the same value is already bound at the index
+	template <typename T>
+	void setArg(cl_uint index, const T& value) {
+		bind(index, value, is_base_of<cl::Memory, T>());
+	}
+
+	operator const cl::Kernel&() const { return kernel; }
+
+	// The number of arguments bound, and the number skipped because the value was already bound
+	cl_ulong getArgumentsSet() const { return argumentsSet; }
+	cl_ulong getArgumentsSkipped() const { return argumentsSkipped; }
+
+private:
+	// The bytes of an argument as the runtime received them, where a local memory argument has its size but no bytes
+	struct BoundArgument {
+		bool set = false;
+		bool local = false;
+		size_t size = 0;
+		vector<unsigned char> bytes;
+
+		// The buffer of a memory argument, which is held so that its handle cannot be reused by a new buffer while it is bound
+		cl::Memory memory;
+	};
+
+	// Bind a scalar or a local memory size
+	template <typename T>
+	void bind(cl_uint index, const T& value, false_type) {
+		size_t size = cl::detail::KernelArgumentHandler<T>::size(value);
+		const void* pointer = cl::detail::KernelArgumentHandler<T>::ptr(value);
+		if (!isBound(index, size, pointer)) {
+			kernel.setArg(index, value);
+			remember(index, size, pointer, cl::Memory());
+		}
+	}
+
+	// Bind a buffer by its handle
+	template <typename T>
+	void bind(cl_uint index, const T& memory, true_type) {
+		const cl_mem handle = memory();
+		if (!isBound(index, sizeof(cl_mem), &handle)) {
+			kernel.setArg(index, memory);
+			remember(index, sizeof(cl_mem), &handle, memory);
+		}
+	}
+
+	// Whether the argument at the index already holds the bytes, counting the skipped binding when it does
+	bool isBound(cl_uint index, size_t size, const void* pointer);
+
+	// Store the bytes of an argument that was just bound
+	void remember(cl_uint index, size_t size, const void* pointer, const cl::Memory& memory);
+
+	cl::Kernel kernel;
+	vector<BoundArgument> arguments;
+	cl_ulong argumentsSet = 0;
+	cl_ulong argumentsSkipped = 0;
+};
+
+// The kernels of one or more programs, each created the first time it is requested and then kept with the arguments bound to it
+// Programs built from the same source with different build options are told apart by a key, which is empty for the generic program
+// A registry is not thread-safe, as the arguments of a kernel can only be bound from one thread at a time
+class KernelRegistry {
+public:
+	// Return the kernel with the given name from the program, creating it on first use
+	CachedKernel& get(const cl::Program& program, const string& programKey, const string& name);
+
+	// The number of kernels created
+	int getKernelCount() const { return (int)kernels.size(); }
+
+	// The number of arguments bound, and the number skipped because the value was already bound, over every kernel
+	cl_ulong getArgumentsSet() const;
+	cl_ulong getArgumentsSkipped() const;
+
+private:
+	map<pair<string, string>, CachedKernel> kernels;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <mutex>
+
+#include "HistogramEqualiser.h"
+
+// One profiled kernel or transfer, with the image and histogram it worked on
+struct StageMetric {
+	// The equalisation the command belongs to, numbered from 0 in the order they were recorded
+	int run;
+	string device;
+
+	// The stage, the command, which is kernel, write, read or fill, and the kernel name for kernels
+	string stage;
+	string command;
+	string kernel;
+
+	// The bytes moved, exactly for transfers and by the number of values read and written for kernels
+	size_t bytes;
+
+	// Whether the host side of a transfer was pinned memory, which is false for kernels
+	bool pinned;
+
+	int binCount;
+	int width;
+	int height;
+	int channels;
+
+	// The device buffers the equalisation requested from the buffer pool, and how many of them had to be allocated
+	int bufferRequests;
+	int bufferAllocations;
+
+	// The profiling times in nanoseconds on the device clock
+	cl_ulong queued;
+	cl_ulong submitted;
+	cl_ulong started;
+	cl_ulong ended;
+
+	cl_ulong duration() const { return ended - started; }
+
+	// The image pixels processed per second and the bytes moved in gigabytes per second, which are 0 for commands that took no time
+	double pixelsPerSecond() const;
+	double gigabytesPerSecond() const;
+
+	// The share of the buffer requests of the equalisation that needed no allocation, which is 0 when it requested none
+	double poolHitRate() const;
+};
+
+// Records the kernels and transfers of equalisations and writes them as a JSON or CSV report
+// Recording is thread-safe, so the equalisers of a batch can share one recorder
+class MetricsRecorder {
+public:
+	// Record every kernel and transfer of an equalisation as one run
+	void recordEqualisation(const EqualiserResult& result, const string& device, int width, int height, int channels, const EqualiserOptions& options);
+
+	// Write an array of objects with one per command, including the derived metrics
+	void writeJSON(ostream& out) const;
+
+	// Write a header row and one row per command, including the derived metrics
+	void writeCSV(ostream& out) const;
+
+	// Write the report to a file, as CSV when the name ends with .csv and JSON otherwise, returning false when it cannot be written
+	bool write(const string& fileName) const;
+
+	size_t size() const;
+
+	// A copy of the recorded commands, in the order of the runs
+	vector<StageMetric> getMetrics() const;
+
+private:
+	// Add a command with the profiling times of its event
+	void add(int run, const string& device, const string& stage, const string& command, const string& kernel, size_t bytes, bool pinned, const cl::Event& event, const EqualiserResult& result, const EqualiserOptions& options, int width, int height, int channels);
+
+	mutable mutex metricsMutex;
+	vector<StageMetric> metrics;
+	int runCount = 0;
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "EqualiserServer.h"
+#include "MetricsRecorder.h"
+#include "ScopedTimer.h"
+
+// Splits batches of images across several OpenCL devices, each with its own context, program and equaliser
+// Every device starts with a share of the batch in proportion to its measured throughput and steals from the others when it runs out
+class MultiDeviceScheduler {
+public:
+	MultiDeviceScheduler(const vector<cl::Device>& devices, const string& kernelFile = "kernels/my_kernels.cl");
+
+	// Every device of every platform on the host
+	static vector<cl::Device> allDevices();
+
+	// The sub-devices of a device partitioned by NUMA node, or the device itself when it cannot be partitioned
+	// Each sub-device is given its own context by the scheduler, but the host threads that feed it are not pinned to its node, so its buffers may be first written from another node
+	static vector<cl::Device> numaSubDevices(const cl::Device& device);
+
+	// Equalise every request into its own output, returning the device that served each request in the order of the batch
+	vector<int> equaliseBatch(const vector<EqualiseRequest>& requests);
+
+	// Equalise one image by splitting its rows into a band per device, which count partial histograms and back-project in parallel
+	// The merged histogram gives the same look-up table as the single-device path, which is built once on the first device
+	// The image must be greyscale or use the YCbCr colour mode, whose luma channel is split after converting it on the host
+	// Throws invalid_argument for the other colour modes of RGB images and for back-projections other than 1, 2 and 3
+	void equaliseSplit(const uint16_t* in, uint16_t* out, int width, int height, int channels, const EqualiserOptions& options);
+
+	// Print the images, pixels, busy time and throughput of each device
+	void printStatistics(ostream& out) const;
+
+	// Record the kernels and transfers of every image of later batches, or stop recording when it is null
+	void setMetrics(MetricsRecorder* recorder) { metrics = recorder; }
+
+	// Aggregate the host time of every image of later batches as one step, or stop when it is null
+	void setTimers(StageTimers* stageTimers) { timers = stageTimers; }
+
+	int getDeviceCount() const { return (int)devices.size(); }
+
+private:
+	struct DeviceState {
+		unique_ptr<HistogramEqualiser> equaliser;
+		string name;
+
+		// The measured throughput in pixels per second, which sets the share of the next batch
+		double weight = 1.0;
+		bool measured = false;
+
+		// The indices of the requests waiting for this device
+		deque<size_t> queue;
+
+		// The totals over every batch
+		cl_ulong images = 0;
+		cl_ulong pixels = 0;
+		double busySeconds = 0.0;
+	};
+
+	// The bounds of a contiguous share of the count for each device, in proportion to the throughput of the devices
+	vector<size_t> shares(size_t count) const;
+
+	// Run the work for every device on a thread of its own, rethrowing the first error once all have finished
+	void runOnDevices(const function<void(size_t)>& work);
+
+	// Add to the totals of a device and update its throughput
+	void recordThroughput(size_t device, cl_ulong pixels, double seconds);
+
+	// Take the next request for a device, stealing from the back of the longest queue when its own is empty
+	bool take(size_t device, size_t& index);
+
+	vector<DeviceState> devices;
+
+	MetricsRecorder* metrics = nullptr;
+	StageTimers* timers = nullptr;
+
+	// The host storage for the YCbCr image of the split mode
+	cimg_library::CImg<unsigned short> imgYCbCr;
+
+	// One lock guards every queue, as requests are whole images and are taken rarely
+	mutex queueMutex;
+};
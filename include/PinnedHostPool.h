@@ -0,0 +1,52 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "BufferPool.h"
+
+// Host memory allocated by the runtime in a buffer created with CL_MEM_ALLOC_HOST_PTR, which stays mapped while the pool exists
+// Transfers from and to pinned memory go straight to the device instead of through a staging copy of the runtime
+struct PinnedBuffer {
+	cl::Buffer buffer;
+	void* host = NULL;
+
+	// The size class of the buffer in bytes, or 0 when it has none yet
+	size_t capacity = 0;
+};
+
+// Pinned host memory recycled by size class in the same way as the device buffers of a buffer pool, so that images of varying sizes reuse earlier allocations
+// Every buffer is mapped once when it is allocated and unmapped when the pool is destroyed, so its host memory must not be used after that
+// The pool is thread-safe, so the equalisers sharing a context can share one pool
+class PinnedHostPool {
+public:
+	explicit PinnedHostPool(const cl::Context& context);
+
+	// Unmap every buffer the pool allocated
+	~PinnedHostPool();
+
+	// The pool owns the mappings, so it cannot be copied
+	PinnedHostPool(const PinnedHostPool&) = delete;
+	PinnedHostPool& operator=(const PinnedHostPool&) = delete;
+
+	// Make a pinned buffer hold at least the size, keeping it while the size falls in its size class and otherwise returning it to the pool for one of the right class
+	// True is returned when a new buffer had to be allocated and mapped
+	bool reserve(PinnedBuffer& buffer, size_t size);
+
+	BufferPoolStatistics getStatistics() const;
+
+private:
+	cl::Context context;
+
+	// The queue the buffers are mapped and unmapped on
+	cl::CommandQueue queue;
+
+	mutable mutex poolMutex;
+
+	// The free buffers of each size class, and every buffer allocated so that they can all be unmapped
+	map<size_t, vector<PinnedBuffer>> freeBuffers;
+	vector<PinnedBuffer> allocated;
+
+	BufferPoolStatistics statistics;
+};
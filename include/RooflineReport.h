@@ -0,0 +1,24 @@
+#pragma once
+
+#include "MetricsRecorder.h"
+
+// Measures the copy bandwidth and atomic throughput of a device with microkernels, and reports how close each kernel of an equalisation comes to them
+// The streaming kernels are compared with the copy bandwidth, and the intensity histograms, which make one atomic increment per value, also with the atomic throughput
+class RooflineReport {
+public:
+	// Calibrate the device of the equaliser, keeping the best of the repetitions of each microkernel
+	RooflineReport(HistogramEqualiser& equaliser, size_t copyBytes = 64 << 20, int repetitions = 5);
+
+	// The copy bandwidth in gigabytes per second, counting the bytes read and written
+	double getCopyBandwidth() const { return copyBandwidth; }
+
+	// The atomic increments per second over a histogram of 256 bins
+	double getAtomicRate() const { return atomicRate; }
+
+	// Print the ceilings and the achieved bandwidth and atomic rate of every kernel in the metrics, with their percentages of the ceilings
+	void print(ostream& out, const vector<StageMetric>& metrics) const;
+
+private:
+	double copyBandwidth = 0.0;
+	double atomicRate = 0.0;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+
+#include "TraceWriter.h"
+
+// The wall-clock times of named host steps, nested under the scoped timers running when they are recorded
+// Repeated steps are aggregated into a count, total, minimum and maximum, so that the images of a batch share one line
+class StageTimers {
+public:
+	StageTimers();
+
+	// Add a timing of a step from any thread, nested under the scoped timers that are running
+	void record(const string& name, chrono::steady_clock::time_point start, chrono::steady_clock::time_point end);
+
+	// Add the host steps of an equalisation, nested one level further, as they ran inside the equalisation
+	void recordEqualisation(const EqualiserResult& result);
+
+	// Also add the steps of the scoped timers to a timeline, or stop when it is null
+	void setTrace(TraceWriter* writer) { trace = writer; }
+
+	// Print a table of the steps and the end-to-end time since the timers were created, with the time outside the top-level steps
+	void print(ostream& out) const;
+
+private:
+	friend class ScopedTimer;
+
+	struct Entry {
+		string name;
+		int depth;
+		cl_ulong count;
+		double total;
+		double minimum;
+		double maximum;
+	};
+
+	// Return the entry of a step at a depth, adding it when it is new, with the lock already held
+	Entry& entry(const string& name, int depth);
+
+	// The number of scoped timers running, read under the lock as steps may be recorded from other threads
+	int currentDepth() const;
+
+	// Add a timing at a depth, also adding it to the timeline when asked
+	void add(const string& name, int depth, chrono::steady_clock::time_point start, chrono::steady_clock::time_point end, bool traced);
+
+	mutable mutex timersMutex;
+	vector<Entry> entries;
+	chrono::steady_clock::time_point created;
+	TraceWriter* trace = nullptr;
+
+	// The number of scoped timers running, which are nested on one thread
+	int depth = 0;
+};
+
+// Times the scope it is declared in, or until it is stopped, and records the step when it ends
+// Scoped timers must end in the reverse order they were started, which declaring them in nested scopes guarantees
+class ScopedTimer {
+public:
+	ScopedTimer(StageTimers& timers, const string& name);
+	~ScopedTimer() { stop(); }
+
+	ScopedTimer(const ScopedTimer&) = delete;
+	ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+	// End the step before the end of the scope, so that values declared inside it stay in scope
+	void stop();
+
+private:
+	StageTimers& timers;
+	string name;
+	chrono::steady_clock::time_point start;
+	bool running = true;
+};
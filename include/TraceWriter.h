@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+
+#include "HistogramEqualiser.h"
+
+// Collects host and device activity as spans and writes them in the trace event format read by Perfetto and about:tracing
+// Device timestamps are moved onto the host clock with an offset measured by a marker on each command queue
+class TraceWriter {
+public:
+	TraceWriter();
+
+	static chrono::steady_clock::time_point now() { return chrono::steady_clock::now(); }
+
+	// Add a span on the host track
+	void addHostSpan(const string& name, chrono::steady_clock::time_point start, chrono::steady_clock::time_point end);
+
+	// Measure the offset from the device clock of a queue to the host clock, giving the device a track of its own
+	void syncDevice(cl::CommandQueue& queue, const string& deviceName);
+
+	// Add the kernels and transfers of an equalisation on the track of its device, which must have been synchronised, and its host conversions on the host track
+	void addEqualisation(const EqualiserResult& result, const string& deviceName);
+
+	// Write the trace as JSON, returning false when it cannot be written
+	bool write(const string& fileName) const;
+
+private:
+	struct Span {
+		string name;
+		string category;
+		int track;
+		cl_ulong bytes;
+
+		// The start and duration in nanoseconds since the trace began
+		cl_long start;
+		cl_long duration;
+	};
+
+	struct DeviceTrack {
+		string name;
+
+		// Added to a device timestamp to give the host time in nanoseconds since the trace began
+		cl_long offset;
+	};
+
+	// Add a device command with its profiling times
+	void addDeviceSpan(const string& name, const string& category, int track, cl_ulong bytes, const cl::Event& event);
+
+	// The nanoseconds between the start of the trace and a host time
+	cl_long sinceStart(chrono::steady_clock::time_point time) const;
+
+	chrono::steady_clock::time_point start;
+	vector<Span> spans;
+	vector<DeviceTrack> deviceTracks;
+};
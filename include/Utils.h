@@ -1,9 +1,14 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <fstream>
 #include <vector>
 #include <iostream>
+#include <random>
 #include <sstream>
+#include <stdexcept>
 
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
 #define CL_HPP_MINIMUM_OPENCL_VERSION 120
@@ -24,13 +29,13 @@ ostream& operator<< (ostream& out, const vector<T>& v) {
 	return out;
 }
 
-string GetPlatformName(int platform_id) {
+inline string GetPlatformName(int platform_id) {
 	vector<cl::Platform> platforms;
 	cl::Platform::get(&platforms);
 	return platforms[platform_id].getInfo<CL_PLATFORM_NAME>();
 }
 
-string GetDeviceName(int platform_id, int device_id) {
+inline string GetDeviceName(int platform_id, int device_id) {
 	vector<cl::Platform> platforms;
 	cl::Platform::get(&platforms);
 	vector<cl::Device> devices;
@@ -38,7 +43,7 @@ string GetDeviceName(int platform_id, int device_id) {
 	return devices[device_id].getInfo<CL_DEVICE_NAME>();
 }
 
-const char *getErrorString(cl_int error) {
+inline const char *getErrorString(cl_int error) {
 	switch (error){
 		// run-time and JIT compiler errors
 	case 0: return "CL_SUCCESS";
@@ -114,21 +119,25 @@ const char *getErrorString(cl_int error) {
 	}
 }
 
-void CheckError(cl_int error) {
+inline void CheckError(cl_int error) {
 	if (error != CL_SUCCESS) {
 		cerr << "OpenCL call failed with error " << getErrorString(error) << endl;
 		exit(1);
 	}
 }
 
-void AddSources(cl::Program::Sources& sources, const string& file_name) {
-	//TODO: add file existence check
+inline void AddSources(cl::Program::Sources& sources, const string& file_name) {
 	ifstream file(file_name);
-	string* source_code = new string(istreambuf_iterator<char>(file), (istreambuf_iterator<char>()));
-	sources.push_back((*source_code).c_str());
+	if (!file) {
+		cerr << "Kernel file " << file_name << " could not be opened" << endl;
+		throw cl::Error(CL_INVALID_VALUE, "AddSources");
+	}
+
+	// The sources hold their own copy of the code, so nothing needs to outlive the program
+	sources.push_back(string(istreambuf_iterator<char>(file), (istreambuf_iterator<char>())));
 }
 
-string ListPlatformsDevices() {
+inline string ListPlatformsDevices() {
 
 	stringstream sstream;
 	vector<cl::Platform> platforms;
@@ -178,7 +187,7 @@ string ListPlatformsDevices() {
 	return sstream.str();
 }
 
-cl::Context GetContext(int platform_id, int device_id) {
+inline cl::Context GetContext(int platform_id, int device_id) {
 	vector<cl::Platform> platforms;
 
 	cl::Platform::get(&platforms);
@@ -198,6 +207,83 @@ cl::Context GetContext(int platform_id, int device_id) {
 	return cl::Context();
 }
 
+// Compute the fixed-point reciprocal of a divisor (Granlund-Montgomery), so that floor(n / divisor) = (t + ((n - t) >> shift1)) >> shift2 with t = mul_hi(n, reciprocal)
+inline void GetFixedPointReciprocal(cl_uint divisor, cl_ulong& reciprocal, int& shift1, int& shift2) {
+	int log2Ceil = 0;
+	while (((cl_ulong)1 << log2Ceil) < divisor)
+		log2Ceil++;
+
+	// Long division of (2^log2Ceil - divisor) * 2^64 by the divisor, as the remainder never exceeds 32 bits
+	cl_ulong remainder = ((cl_ulong)1 << log2Ceil) - divisor;
+	cl_ulong quotient = 0;
+	for (int i = 0; i < 64; i++) {
+		remainder <<= 1;
+		quotient <<= 1;
+		if (remainder >= divisor) {
+			remainder -= divisor;
+			quotient |= 1;
+		}
+	}
+
+	reciprocal = quotient + 1;
+	shift1 = min(log2Ceil, 1);
+	shift2 = max(log2Ceil - 1, 0);
+}
+
+// Fill a plane of a synthetic image with values between 0 and the maximum intensity from a uniform, gaussian, spike or ramp distribution
+inline void GenerateSyntheticPlane(vector<unsigned short>& plane, size_t offset, size_t pixelCount, const string& distribution, int maxIntensity, mt19937& generator) {
+	if (distribution == "uniform") {
+		uniform_int_distribution<int> values(0, maxIntensity);
+		for (size_t i = 0; i < pixelCount; i++) {
+			plane[offset + i] = (unsigned short)values(generator);
+		}
+	}
+
+	// A dark, narrow peak, as in an under-exposed photograph
+	else if (distribution == "gaussian") {
+		normal_distribution<double> values(maxIntensity / 4.0, maxIntensity / 16.0);
+		for (size_t i = 0; i < pixelCount; i++) {
+			plane[offset + i] = (unsigned short)min(max((int)lround(values(generator)), 0), maxIntensity);
+		}
+	}
+
+	// Every pixel has the same value, so every atomic increment hits one bin
+	else if (distribution == "spike") {
+		fill(plane.begin() + offset, plane.begin() + offset + pixelCount, (unsigned short)(maxIntensity / 2));
+	}
+
+	// Values rise evenly across the image, so neighbouring work items share bins
+	else if (distribution == "ramp") {
+		for (size_t i = 0; i < pixelCount; i++) {
+			plane[offset + i] = (unsigned short)(i * (maxIntensity + 1) / pixelCount);
+		}
+	}
+
+	else {
+		throw invalid_argument("unknown distribution " + distribution);
+	}
+}
+
+// Quote a string for JSON, escaping its quotes, backslashes and control characters
+inline string JsonString(const string& value) {
+	string escaped = "\"";
+	for (char c : value) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+			escaped += c;
+		}
+		else if ((unsigned char)c < 0x20) {
+			char code[7];
+			snprintf(code, sizeof(code), "\\u%04x", c);
+			escaped += code;
+		}
+		else {
+			escaped += c;
+		}
+	}
+	return escaped + "\"";
+}
+
 enum ProfilingResolution {
 	PROF_NS = 1,
 	PROF_US = 1000,
@@ -205,7 +291,7 @@ enum ProfilingResolution {
 	PROF_S = 1000000000
 };
 
-string GetFullProfilingInfo(const cl::Event& evnt, ProfilingResolution resolution) {
+inline string GetFullProfilingInfo(const cl::Event& evnt, ProfilingResolution resolution) {
 	stringstream sstream;
 
 	sstream << "Queued " << (evnt.getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>() - evnt.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>()) / resolution;
@@ -1,3 +1,32 @@
+// The host can build a specialised program with the histogram parameters fixed at compile time, using -D BIN_COUNT, -D MAX_INTENSITY and -D INCREMENTS
+// The constants stand in for the arguments of the same meaning, so that the compiler can unroll the loops over the bins and strength-reduce the divisions
+#ifdef BIN_COUNT
+#define BINS BIN_COUNT
+#else
+#define BINS binCount
+#endif
+
+#ifdef MAX_INTENSITY
+#define MAX_LEVEL MAX_INTENSITY
+#else
+#define MAX_LEVEL maxIntensity
+#endif
+
+#ifdef INCREMENTS
+#define BIN_WIDTH INCREMENTS
+#else
+#define BIN_WIDTH increments
+#endif
+
+// SHIFT is only defined when the bin width is a power of two, so that finding the bin of a value is a shift instead of an integer division
+#ifdef SHIFT
+#define BIN_OF(value) ((value) >> SHIFT)
+#define BIN_START(bin) ((bin) << SHIFT)
+#else
+#define BIN_OF(value) ((value) / BIN_WIDTH)
+#define BIN_START(bin) ((bin) * BIN_WIDTH)
+#endif
+
 // Calculate an intensity histogram from the input image
 kernel void intHistogram(global const ushort* A, global int* B) {
 	// Get the global ID of the current item and store it in a variable
@@ -19,10 +48,10 @@ kernel void intHistogram2(global const ushort* A, global int* B, int binCount, i
 	int index = A[globalID];
 
 	// Determine which bin the pixel value belongs to
-	int binIndex = (int)(index / increments);
+	int binIndex = BIN_OF(index);
 
 	// Ensure the pixel value is within the bounds of the histogram
-	binIndex = clamp(binIndex, 0, binCount - 1);
+	binIndex = clamp(binIndex, 0, BINS - 1);
 
 	// Atomically increment the value of the output array at the 'binIndex' point
 	atomic_inc(&B[binIndex]);
@@ -43,7 +72,7 @@ kernel void intHistogram3(global const ushort* A, global int* B, int imgSize, in
 	int localSize = get_local_size(0);
 
 	// Initialise the local buffer to zero for each work item
-	for (int i = localID; i < binCount; i += localSize) {
+	for (int i = localID; i < BINS; i += localSize) {
 		localBuffer[i] = 0;
 	}
 
@@ -52,16 +81,16 @@ kernel void intHistogram3(global const ushort* A, global int* B, int imgSize, in
 
 	// Iterate over all of the pixels and increment the respective bin in the local buffer
 	for (int i = globalID; i < imgSize; i += globalSize) {
-		for (int j = 0; j < binCount - 1; j++) {
+		for (int j = 0; j < BINS - 1; j++) {
 			if (A[i] >= histoSizeBuffer[j] && A[i] < histoSizeBuffer[j + 1]) {
 				// Atomically increment the corresponding bin in the local buffer
 				atomic_inc(&localBuffer[j]);
 				break;
 			}
 		}
-		if (A[i] >= histoSizeBuffer[binCount - 1]) {
+		if (A[i] >= histoSizeBuffer[BINS - 1]) {
 			// Atomically increment the last bin in the local buffer
-			atomic_inc(&localBuffer[binCount - 1]);
+			atomic_inc(&localBuffer[BINS - 1]);
 		}
 	}
 
@@ -69,13 +98,54 @@ kernel void intHistogram3(global const ushort* A, global int* B, int imgSize, in
 	barrier(CLK_LOCAL_MEM_FENCE);
 
 	// Add the local buffer to the global buffer to produce the final histogram
-	for (int i = localID; i < binCount - 1; i += localSize) {
+	for (int i = localID; i < BINS - 1; i += localSize) {
 		// Atomically add the corresponding bin into the global buffer
 		atomic_add(&B[i], localBuffer[i]);
 	}
-	if (localID == 0 && binCount > 0) {
+	if (localID == 0 && BINS > 0) {
 		// Add the count for the last bin to the global buffer
-		atomic_add(&B[binCount - 1], localBuffer[binCount - 1]);
+		atomic_add(&B[BINS - 1], localBuffer[BINS - 1]);
+	}
+}
+
+// Calculate the histogram of each channel of an RGB image, stored one plane after another, using a local sub-histogram per channel
+kernel void intHistogramRGB(global const ushort* A, global int* B, int imgSize, int binCount, int increments, local int* localBuffer) {
+	// Get the global ID of the current item and store it in a variable
+	int globalID = get_global_id(0);
+
+	// Get the local ID of the current item and store it in a variable
+	int localID = get_local_id(0);
+
+	// Get the size of the local items and store it in a variable
+	int localSize = get_local_size(0);
+
+	// Initialise the three local sub-histograms to zero
+	for (int i = localID; i < 3 * BINS; i += localSize) {
+		localBuffer[i] = 0;
+	}
+
+	// Synchronise all work items in the work group
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// The global size is rounded up to the work-group size, so only the items inside the image read a pixel
+	if (globalID < imgSize) {
+		for (int channel = 0; channel < 3; channel++) {
+			// Determine which bin the channel value belongs to, within the bounds of the histogram
+			int binIndex = min(BIN_OF(A[channel * imgSize + globalID]), BINS - 1);
+
+			// Atomically increment the corresponding bin in the sub-histogram of the channel
+			atomic_inc(&localBuffer[channel * BINS + binIndex]);
+		}
+	}
+
+	// Synchronise all work items in the work group
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// Add the local sub-histograms to the global buffer to produce the final histograms
+	for (int i = localID; i < 3 * BINS; i += localSize) {
+		if (localBuffer[i] > 0) {
+			atomic_add(&B[i], localBuffer[i]);
+		}
 	}
 }
 
@@ -220,6 +290,119 @@ kernel void cumHistogramHS2(__global const int* A, global int* B, local int* X,
 	B[globalID] = X[localID];
 }
 
+// Compute the fixed-point reciprocal of a divisor, matching GetFixedPointReciprocal on the host
+ulong fixedPointReciprocal(uint divisor, int log2Ceil) {
+	// Long division of (2^log2Ceil - divisor) * 2^64 by the divisor
+	ulong remainder = ((ulong)1 << log2Ceil) - divisor;
+	ulong quotient = 0;
+	for (int i = 0; i < 64; i++) {
+		remainder <<= 1;
+		quotient <<= 1;
+		if (remainder >= divisor) {
+			remainder -= divisor;
+			quotient |= 1;
+		}
+	}
+
+	return quotient + 1;
+}
+
+// Divide a 64-bit numerator using a fixed-point reciprocal and the two shifts derived from the divisor
+int fixedPointDivide(ulong numerator, ulong reciprocal, int shift1, int shift2) {
+	// Multiply by the reciprocal, keeping the upper 64 bits of the 128-bit product
+	ulong product = mul_hi(numerator, reciprocal);
+
+	// Correct the truncated product and shift it down to give the exact quotient of the division
+	return (int)((product + ((numerator - product) >> shift1)) >> shift2);
+}
+
+// Calculate a cumulative histogram using the Hillis-Steele pattern, and write the look-up table from the same work group
+// The look-up table uses (cdf(v) - cdf_min) / (N - cdf_min) * maxIntensity, where N is the last cumulative value of the work group
+kernel void cumHistogramLUT(global const int* A, global int* B, global int* LUT, const int maxIntensity, local int* X, local int* Y) {
+	// Get the global ID of the current item and store it in a variable
+	int globalID = get_global_id(0);
+
+	// Get the local ID of the current item and store it in a variable
+	int localID = get_local_id(0);
+
+	// Get the size of the local items and store it in a variable
+	int localSize = get_local_size(0);
+
+	// Create a pointer variable
+	local int* Z;
+
+	// Create a variable shared by the work group for the reciprocal of the denominator
+	local ulong reciprocal;
+
+	// Copy the input data into the local memory of the work group
+	X[localID] = A[globalID];
+
+	// Synchronise all work items in the work group
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// Perform the Hillis-Steele algorithm to calculate the cumulative histogram
+	for (int i = 1; i < localSize; i *= 2) {
+		// Add the value from the previous iteration at the current offset, or copy it if there is none
+		Y[localID] = (localID >= i) ? X[localID] + X[localID - i] : X[localID];
+
+		// Synchronise all work items in the work group
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		// Swap the pointers to the input and output arrays before the next iteration
+		Z = Y;
+		Y = X;
+		X = Z;
+	}
+
+	// Copy the cumulative histogram back to the global memory
+	B[globalID] = X[localID];
+
+	// Use the spare buffer for the minimum reduction, ignoring the empty bins
+	Y[localID] = (X[localID] > 0) ? X[localID] : INT_MAX;
+
+	// Synchronise all work items in the work group
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// Reduce the spare buffer to its minimum, checking the bounds so that any work group size can be used
+	for (int i = 1; i < localSize; i *= 2) {
+		if ((localID % (i * 2)) == 0 && (localID + i) < localSize) {
+			Y[localID] = min(Y[localID], Y[localID + i]);
+		}
+
+		// Synchronise all work items in the work group
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	// Read the minimum and the total of the cumulative histogram
+	int cdfMin = Y[0];
+	int denominator = X[localSize - 1] - cdfMin;
+
+	// Determine the shifts for the reciprocal of the denominator
+	int log2Ceil = (denominator > 1) ? 32 - clz((uint)(denominator - 1)) : 0;
+
+	// Calculate the reciprocal of the denominator once for the work group
+	if (localID == 0 && denominator > 0) {
+		reciprocal = fixedPointReciprocal((uint)denominator, log2Ceil);
+	}
+
+	// Synchronise all work items in the work group
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// An image with a single intensity level has no range to stretch, so it is mapped to zero
+	if (denominator > 0) {
+		// Normalise the cumulative histogram to a maximum, respective to the bit depth
+		ulong numerator = (ulong)max(X[localID] - cdfMin, 0) * MAX_LEVEL;
+		LUT[globalID] = fixedPointDivide(numerator, reciprocal, min(log2Ceil, 1), max(log2Ceil - 1, 0));
+	}
+	else {
+		LUT[globalID] = 0;
+	}
+}
+
+// The double-precision look-up tables are only compiled on devices that support the fp64 extension
+#ifdef cl_khr_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+
 // Store the normalised cumulative histogram to a look-up table for mapping the original intensities onto the output image
 kernel void lookupTable(global int* A, global int* B, const int maxIntensity) {
 	// Get the global ID of the current item and store it in a variable
@@ -229,7 +412,7 @@ kernel void lookupTable(global int* A, global int* B, const int maxIntensity) {
 	int index = A[globalID];
 
 	// Calculate the value for the output
-	B[globalID] = index * (double)maxIntensity / A[maxIntensity];
+	B[globalID] = index * (double)MAX_LEVEL / A[MAX_LEVEL];
 }
 
 // Store the normalised cumulative histogram to a look-up table for mapping the original intensities onto the output image
@@ -241,7 +424,7 @@ kernel void lookupTable2(global int* A, global int* B, const int maxIntensity, i
 	int index = A[globalID];
 
 	// Normalise the histogram to a maximum, respective to the bit depth.
-	B[globalID] = index * (double)maxIntensity / A[binCount - 1];
+	B[globalID] = index * (double)MAX_LEVEL / A[BINS - 1];
 }
 
 // Store the normalised cumulative histogram to a look-up table for mapping the original intensities onto the output image
@@ -255,7 +438,7 @@ kernel void lookupTable3(global int* A, global int* B, const int maxIntensity, i
 	// Copy a chunk of the input array to local memory
 	int chunkSize = get_local_size(0);
 	int localID = get_local_id(0);
-	for (int i = localID; i < binCount; i += chunkSize) {
+	for (int i = localID; i < BINS; i += chunkSize) {
 		localA[i] = A[i];
 	}
 
@@ -266,7 +449,46 @@ kernel void lookupTable3(global int* A, global int* B, const int maxIntensity, i
 	int index = localA[globalID];
 
 	// Normalise the histogram to a maximum, respective to the bit depth.
-	B[globalID] = index * (double)maxIntensity / localA[binCount - 1];
+	B[globalID] = index * (double)MAX_LEVEL / localA[BINS - 1];
+}
+
+#endif
+
+// Store the normalised cumulative histogram to a look-up table using a fixed-point reciprocal of the last cumulative value, avoiding double-precision division
+kernel void lookupTable4(global int* A, global int* B, const int maxIntensity, ulong reciprocal, int shift1, int shift2) {
+	// Get the global ID of the current item and store it in a variable
+	int globalID = get_global_id(0);
+
+	// Scale the value of the array at the 'ID' point by the maximum intensity, widening to 64 bits to avoid overflow
+	ulong numerator = (ulong)A[globalID] * MAX_LEVEL;
+
+	// Divide by the last cumulative value using the reciprocal
+	B[globalID] = fixedPointDivide(numerator, reciprocal, shift1, shift2);
+}
+
+// Store a look-up table mapping each level onto the target level with the nearest cumulative proportion, by inverting the target cumulative histogram
+kernel void histogramMatch(global const int* A, global const int* T, global int* LUT, int binCount, int increments, int maxIntensity) {
+	// Get the global ID of the current item and store it in a variable
+	int globalID = get_global_id(0);
+
+	// Cross-multiply by the totals, so that cumulative histograms of different pixel counts are compared without division
+	ulong source = (ulong)A[globalID] * T[BINS - 1];
+
+	// Use a binary search to find the first target level whose cumulative proportion reaches the source
+	int left = 0;
+	int right = BINS - 1;
+	while (left < right) {
+		int middle = (left + right) / 2;
+		if ((ulong)T[middle] * A[BINS - 1] >= source) {
+			right = middle;
+		}
+		else {
+			left = middle + 1;
+		}
+	}
+
+	// Set the value for the output to the intensity at the start of the target bin
+	LUT[globalID] = min(BIN_START(left), MAX_LEVEL);
 }
 
 // Back-project each output pixel by indexing the look-up table with the original intensity level
@@ -290,7 +512,7 @@ kernel void backprojection2(global ushort* A, global int* LUT, global ushort* B,
 	int index = A[globalID];
 
 	// Loop through each bin in the histogram
-	for (int i = 0; i < binCount; i++) {
+	for (int i = 0; i < BINS; i++) {
 		// Check if the input intensity falls within the current bin
 		if (index >= histoSizeBuffer[i] && index < histoSizeBuffer[i + 1]) {
 			// Map the input intensity to the output intensity using the look-up table
@@ -309,7 +531,7 @@ kernel void backprojection3(global ushort* A, global int* LUT, global ushort* B,
 
 	// Use a binary search to find the bin index that the input intensity falls within
 	int left = 0;
-	int right = binCount - 1;
+	int right = BINS - 1;
 	while (left <= right) {
 		int middle = (left + right) / 2;
 		if (index < histoSizeBuffer[middle]) {
@@ -324,3 +546,398 @@ kernel void backprojection3(global ushort* A, global int* LUT, global ushort* B,
 		}
 	}
 }
+
+// Back-project every channel of an RGB pixel, stored one plane after another, using the look-up table of each channel
+kernel void backprojectionRGB(global const ushort* A, global const int* LUT, global ushort* B, int imgSize, int binCount, int increments) {
+	// Get the global ID of the current item and store it in a variable
+	int globalID = get_global_id(0);
+
+	// Loop through each channel of the pixel
+	for (int channel = 0; channel < 3; channel++) {
+		// Determine which bin the channel value belongs to, within the bounds of the histogram
+		int binIndex = min(BIN_OF(A[channel * imgSize + globalID]), BINS - 1);
+
+		// Set the value for the output using the look-up table of the channel
+		B[channel * imgSize + globalID] = LUT[channel * BINS + binIndex];
+	}
+}
+
+// The tiled kernels run over a 2D range of row tiles, where each work item covers itemsPerThread pixels of its row spaced one tile width apart
+// Neighbouring items of a tile read neighbouring pixels on every step, and the items past the right or bottom edge of the image are skipped
+// Calculate an intensity histogram from the input image over row tiles, with a local sub-histogram for each tile
+kernel void intHistogram2D(global const ushort* A, global int* B, int width, int height, int binCount, int increments, int itemsPerThread, local int* localBuffer) {
+	// Get the row of the current item, and the first column it covers
+	int y = get_global_id(1);
+	int x = get_group_id(0) * get_local_size(0) * itemsPerThread + get_local_id(0);
+
+	// Get the position of the item within its tile, and the number of items in the tile
+	int localID = get_local_id(1) * get_local_size(0) + get_local_id(0);
+	int localSize = get_local_size(0) * get_local_size(1);
+
+	// Initialise the local sub-histogram to zero
+	for (int i = localID; i < BINS; i += localSize) {
+		localBuffer[i] = 0;
+	}
+
+	// Synchronise all work items in the work group
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// Count the pixels of the item that lie inside the image
+	if (y < height) {
+		for (int i = 0; i < itemsPerThread && x < width; i++, x += get_local_size(0)) {
+			// Determine which bin the pixel value belongs to, within the bounds of the histogram
+			int binIndex = min(BIN_OF((int)A[y * width + x]), BINS - 1);
+
+			// Atomically increment the corresponding bin in the local sub-histogram
+			atomic_inc(&localBuffer[binIndex]);
+		}
+	}
+
+	// Synchronise all work items in the work group
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// Add the local sub-histogram to the global buffer to produce the final histogram
+	for (int i = localID; i < BINS; i += localSize) {
+		if (localBuffer[i] > 0) {
+			atomic_add(&B[i], localBuffer[i]);
+		}
+	}
+}
+
+// Back-project each output pixel over row tiles by indexing the look-up table with the bin of the original intensity level
+kernel void backprojection2D(global const ushort* A, global const int* LUT, global ushort* B, int width, int height, int binCount, int increments, int itemsPerThread) {
+	// Get the row of the current item, and the first column it covers
+	int y = get_global_id(1);
+	int x = get_group_id(0) * get_local_size(0) * itemsPerThread + get_local_id(0);
+
+	// Back-project the pixels of the item that lie inside the image
+	if (y < height) {
+		for (int i = 0; i < itemsPerThread && x < width; i++, x += get_local_size(0)) {
+			// Determine which bin the pixel value belongs to, within the bounds of the histogram
+			int binIndex = min(BIN_OF((int)A[y * width + x]), BINS - 1);
+
+			// Set the value for the output using the value from the look-up table
+			B[y * width + x] = LUT[binIndex];
+		}
+	}
+}
+
+// The persistent kernels launch a fixed number of work groups for the device, and each work item loops over the image with a stride of the global size
+// Calculate an intensity histogram from the input image, with a local sub-histogram for each persistent work group
+kernel void intHistogramPersistent(global const ushort* A, global int* B, int imgSize, int binCount, int increments, local int* localBuffer) {
+	// Get the local ID and the work group size and store them in variables
+	int localID = get_local_id(0);
+	int localSize = get_local_size(0);
+
+	// Initialise the local sub-histogram to zero
+	for (int i = localID; i < BINS; i += localSize) {
+		localBuffer[i] = 0;
+	}
+
+	// Synchronise all work items in the work group
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// Count every pixel a global size apart, starting from the global ID
+	for (int i = get_global_id(0); i < imgSize; i += get_global_size(0)) {
+		// Determine which bin the pixel value belongs to, within the bounds of the histogram
+		int binIndex = min(BIN_OF((int)A[i]), BINS - 1);
+
+		// Atomically increment the corresponding bin in the local sub-histogram
+		atomic_inc(&localBuffer[binIndex]);
+	}
+
+	// Synchronise all work items in the work group
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// Add the local sub-histogram to the global buffer to produce the final histogram
+	for (int i = localID; i < BINS; i += localSize) {
+		if (localBuffer[i] > 0) {
+			atomic_add(&B[i], localBuffer[i]);
+		}
+	}
+}
+
+// Back-project the output pixels a global size apart by indexing the look-up table with the bin of the original intensity level
+kernel void backprojectionPersistent(global const ushort* A, global const int* LUT, global ushort* B, int imgSize, int binCount, int increments) {
+	for (int i = get_global_id(0); i < imgSize; i += get_global_size(0)) {
+		// Determine which bin the pixel value belongs to, within the bounds of the histogram
+		int binIndex = min(BIN_OF((int)A[i]), BINS - 1);
+
+		// Set the value for the output using the value from the look-up table
+		B[i] = LUT[binIndex];
+	}
+}
+
+// The image kernels are only compiled on devices that support images
+#ifdef __IMAGE_SUPPORT__
+// Read the texels of the intensity image unfiltered at their integer coordinates
+constant sampler_t pixelSampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+// Calculate an intensity histogram from the intensity image over row tiles, with a local sub-histogram for each tile
+kernel void intHistogramImage(read_only image2d_t A, global int* B, int binCount, int increments, int itemsPerThread, local int* localBuffer) {
+	// Get the coordinates of the first pixel of the current item, which covers its row in the same way as the tiled kernels
+	int2 coord = (int2)(get_group_id(0) * get_local_size(0) * itemsPerThread + get_local_id(0), get_global_id(1));
+
+	// Get the position of the item within its tile, and the number of items in the tile
+	int localID = get_local_id(1) * get_local_size(0) + get_local_id(0);
+	int localSize = get_local_size(0) * get_local_size(1);
+
+	// Initialise the local sub-histogram to zero
+	for (int i = localID; i < BINS; i += localSize) {
+		localBuffer[i] = 0;
+	}
+
+	// Synchronise all work items in the work group
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// The global size is rounded up to whole tiles, so only the pixels inside the image are read
+	if (coord.y < get_image_height(A)) {
+		for (int i = 0; i < itemsPerThread && coord.x < get_image_width(A); i++, coord.x += get_local_size(0)) {
+			// Determine which bin the pixel value belongs to, within the bounds of the histogram
+			int binIndex = min(BIN_OF((int)read_imageui(A, pixelSampler, coord).x), BINS - 1);
+
+			// Atomically increment the corresponding bin in the local sub-histogram
+			atomic_inc(&localBuffer[binIndex]);
+		}
+	}
+
+	// Synchronise all work items in the work group
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// Add the local sub-histogram to the global buffer to produce the final histogram
+	for (int i = localID; i < BINS; i += localSize) {
+		if (localBuffer[i] > 0) {
+			atomic_add(&B[i], localBuffer[i]);
+		}
+	}
+}
+
+// Back-project each pixel of the input image through the look-up table into the output image
+kernel void backprojectionImage(read_only image2d_t A, global const int* LUT, write_only image2d_t B, int binCount, int increments, int itemsPerThread) {
+	// Get the coordinates of the first pixel of the current item, which covers its row in the same way as the tiled kernels
+	int2 coord = (int2)(get_group_id(0) * get_local_size(0) * itemsPerThread + get_local_id(0), get_global_id(1));
+
+	// The global size is rounded up to whole tiles, so only the pixels inside the image are written
+	if (coord.y < get_image_height(A)) {
+		for (int i = 0; i < itemsPerThread && coord.x < get_image_width(A); i++, coord.x += get_local_size(0)) {
+			// Determine which bin the pixel value belongs to, within the bounds of the histogram
+			int binIndex = min(BIN_OF((int)read_imageui(A, pixelSampler, coord).x), BINS - 1);
+
+			// Set the value for the output using the value from the look-up table
+			write_imageui(B, coord, (uint4)(LUT[binIndex], 0, 0, 0));
+		}
+	}
+}
+#endif
+
+// Calculate the hue of an RGB pixel in sextants, between 0 and 6, from its largest component and chroma
+float hueFromRGB(float red, float green, float blue, float maxValue, float chroma) {
+	// A grey pixel has no hue
+	if (chroma == 0.0f) {
+		return 0.0f;
+	}
+
+	// Measure the hue from the sextant of the largest component
+	if (maxValue == red) {
+		float hue = (green - blue) / chroma;
+		return (hue < 0.0f) ? hue + 6.0f : hue;
+	}
+	else if (maxValue == green) {
+		return (blue - red) / chroma + 2.0f;
+	}
+	else {
+		return (red - green) / chroma + 4.0f;
+	}
+}
+
+// Rebuild the RGB components of a pixel from its hue, chroma and smallest component, writing them to the output array
+void rgbFromHue(float hue, float chroma, float minValue, float* rgb) {
+	// Calculate the middle component from the position of the hue within its sextant
+	float middle = chroma * (1.0f - fabs(fmod(hue, 2.0f) - 1.0f));
+
+	// Order the components according to the sextant of the hue
+	int sextant = min((int)hue, 5);
+	float red = (sextant == 0 || sextant == 5) ? chroma : (sextant == 1 || sextant == 4) ? middle : 0.0f;
+	float green = (sextant == 1 || sextant == 2) ? chroma : (sextant == 0 || sextant == 3) ? middle : 0.0f;
+	float blue = (sextant == 3 || sextant == 4) ? chroma : (sextant == 2 || sextant == 5) ? middle : 0.0f;
+
+	// Raise every component by the smallest component
+	rgb[0] = red + minValue;
+	rgb[1] = green + minValue;
+	rgb[2] = blue + minValue;
+}
+
+// Convert planar RGB to HSV, storing the value as the intensity channel and the hue and saturation one plane after another
+kernel void rgbToHSV(global const ushort* A, global ushort* B, global float* C, int imgSize, int maxIntensity) {
+	// Get the global ID of the current item and store it in a variable
+	int globalID = get_global_id(0);
+
+	// Read the three channels of the pixel
+	float red = A[globalID];
+	float green = A[imgSize + globalID];
+	float blue = A[2 * imgSize + globalID];
+
+	// Find the largest and smallest components of the pixel
+	float maxValue = fmax(red, fmax(green, blue));
+	float minValue = fmin(red, fmin(green, blue));
+	float chroma = maxValue - minValue;
+
+	// Store the hue and saturation for the conversion back to RGB
+	C[globalID] = hueFromRGB(red, green, blue, maxValue, chroma);
+	C[imgSize + globalID] = (maxValue > 0.0f) ? chroma / maxValue : 0.0f;
+
+	// Set the value for the output to the value, which is already a whole intensity
+	B[globalID] = (ushort)maxValue;
+}
+
+// Convert HSV back to planar RGB using the equalised value with the stored hue and saturation
+kernel void hsvToRGB(global const ushort* A, global const float* C, global ushort* B, int imgSize, int maxIntensity) {
+	// Get the global ID of the current item and store it in a variable
+	int globalID = get_global_id(0);
+
+	// Calculate the chroma from the equalised value and the stored saturation
+	float value = A[globalID];
+	float chroma = value * C[imgSize + globalID];
+
+	// Rebuild the components of the pixel
+	float rgb[3];
+	rgbFromHue(C[globalID], chroma, value - chroma, rgb);
+
+	// Set the values for the output, rounded within the range of the image
+	B[globalID] = convert_ushort_sat_rte(fmin(rgb[0], (float)MAX_LEVEL));
+	B[imgSize + globalID] = convert_ushort_sat_rte(fmin(rgb[1], (float)MAX_LEVEL));
+	B[2 * imgSize + globalID] = convert_ushort_sat_rte(fmin(rgb[2], (float)MAX_LEVEL));
+}
+
+// Convert planar RGB to HSL, storing the lightness as the intensity channel and the hue and saturation one plane after another
+kernel void rgbToHSL(global const ushort* A, global ushort* B, global float* C, int imgSize, int maxIntensity) {
+	// Get the global ID of the current item and store it in a variable
+	int globalID = get_global_id(0);
+
+	// Read the three channels of the pixel
+	float red = A[globalID];
+	float green = A[imgSize + globalID];
+	float blue = A[2 * imgSize + globalID];
+
+	// Find the largest and smallest components of the pixel
+	float maxValue = fmax(red, fmax(green, blue));
+	float minValue = fmin(red, fmin(green, blue));
+	float chroma = maxValue - minValue;
+
+	// Calculate the lightness and the largest chroma that it allows
+	float lightness = (maxValue + minValue) * 0.5f;
+	float chromaRange = MAX_LEVEL - fabs(2.0f * lightness - MAX_LEVEL);
+
+	// Store the hue and saturation for the conversion back to RGB
+	C[globalID] = hueFromRGB(red, green, blue, maxValue, chroma);
+	C[imgSize + globalID] = (chromaRange > 0.0f) ? chroma / chromaRange : 0.0f;
+
+	// Set the value for the output to the rounded lightness
+	B[globalID] = convert_ushort_sat_rte(lightness);
+}
+
+// Convert HSL back to planar RGB using the equalised lightness with the stored hue and saturation
+kernel void hslToRGB(global const ushort* A, global const float* C, global ushort* B, int imgSize, int maxIntensity) {
+	// Get the global ID of the current item and store it in a variable
+	int globalID = get_global_id(0);
+
+	// Calculate the chroma from the equalised lightness and the stored saturation
+	float lightness = A[globalID];
+	float chroma = (MAX_LEVEL - fabs(2.0f * lightness - MAX_LEVEL)) * C[imgSize + globalID];
+
+	// Rebuild the components of the pixel
+	float rgb[3];
+	rgbFromHue(C[globalID], chroma, lightness - chroma * 0.5f, rgb);
+
+	// Set the values for the output, rounded within the range of the image
+	B[globalID] = convert_ushort_sat_rte(fmin(rgb[0], (float)MAX_LEVEL));
+	B[imgSize + globalID] = convert_ushort_sat_rte(fmin(rgb[1], (float)MAX_LEVEL));
+	B[2 * imgSize + globalID] = convert_ushort_sat_rte(fmin(rgb[2], (float)MAX_LEVEL));
+}
+
+// Remove the sRGB gamma from a component between 0 and 1
+float srgbToLinear(float value) {
+	return (value <= 0.04045f) ? value / 12.92f : pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+// Apply the sRGB gamma to a linear component between 0 and 1
+float linearToSRGB(float value) {
+	return (value <= 0.0031308f) ? value * 12.92f : 1.055f * pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+// The CIE Lab companding function, which is linear near black
+float labCompand(float value) {
+	return (value > 0.008856452f) ? cbrt(value) : value / 0.128418549f + 0.137931034f;
+}
+
+// The inverse of the CIE Lab companding function
+float labExpand(float value) {
+	return (value > 0.206896552f) ? value * value * value : 0.128418549f * (value - 0.137931034f);
+}
+
+// Convert planar sRGB to CIE Lab under D65, storing L* scaled to the image range as the intensity channel and a* and b* one plane after another
+kernel void rgbToLab(global const ushort* A, global ushort* B, global float* C, int imgSize, int maxIntensity) {
+	// Get the global ID of the current item and store it in a variable
+	int globalID = get_global_id(0);
+
+	// Read the three channels of the pixel and remove the gamma
+	float red = srgbToLinear((float)A[globalID] / MAX_LEVEL);
+	float green = srgbToLinear((float)A[imgSize + globalID] / MAX_LEVEL);
+	float blue = srgbToLinear((float)A[2 * imgSize + globalID] / MAX_LEVEL);
+
+	// Convert to XYZ relative to the D65 white point
+	float x = labCompand((0.4124564f * red + 0.3575761f * green + 0.1804375f * blue) / 0.95047f);
+	float y = labCompand(0.2126729f * red + 0.7151522f * green + 0.0721750f * blue);
+	float z = labCompand((0.0193339f * red + 0.1191920f * green + 0.9503041f * blue) / 1.08883f);
+
+	// Store a* and b* for the conversion back to RGB
+	C[globalID] = 500.0f * (x - y);
+	C[imgSize + globalID] = 200.0f * (y - z);
+
+	// Set the value for the output to L*, scaled from 0-100 to the range of the image
+	B[globalID] = convert_ushort_sat_rte((116.0f * y - 16.0f) * MAX_LEVEL / 100.0f);
+}
+
+// Convert CIE Lab back to planar sRGB using the equalised L* with the stored a* and b*
+kernel void labToRGB(global const ushort* A, global const float* C, global ushort* B, int imgSize, int maxIntensity) {
+	// Get the global ID of the current item and store it in a variable
+	int globalID = get_global_id(0);
+
+	// Recover the companded XYZ from the equalised L* and the stored a* and b*
+	float y = ((float)A[globalID] * 100.0f / MAX_LEVEL + 16.0f) / 116.0f;
+	float x = y + C[globalID] / 500.0f;
+	float z = y - C[imgSize + globalID] / 200.0f;
+
+	// Expand to XYZ relative to the D65 white point
+	x = labExpand(x) * 0.95047f;
+	y = labExpand(y);
+	z = labExpand(z) * 1.08883f;
+
+	// Convert to linear RGB, keeping colours outside the gamut within range
+	float red = clamp(3.2404542f * x - 1.5371385f * y - 0.4985314f * z, 0.0f, 1.0f);
+	float green = clamp(-0.9692660f * x + 1.8760108f * y + 0.0415560f * z, 0.0f, 1.0f);
+	float blue = clamp(0.0556434f * x - 0.2040259f * y + 1.0572252f * z, 0.0f, 1.0f);
+
+	// Set the values for the output after applying the gamma, rounded to the range of the image
+	B[globalID] = convert_ushort_sat_rte(linearToSRGB(red) * MAX_LEVEL);
+	B[imgSize + globalID] = convert_ushort_sat_rte(linearToSRGB(green) * MAX_LEVEL);
+	B[2 * imgSize + globalID] = convert_ushort_sat_rte(linearToSRGB(blue) * MAX_LEVEL);
+}
+
+// Copy the input to the output sixteen bytes per work item, which measures the memory bandwidth ceiling of the streaming kernels
+kernel void copyCalibration(global const uint4* A, global uint4* B) {
+	// Get the global ID of the current item and store it in a variable
+	int globalID = get_global_id(0);
+
+	// Copy the value of the array at the 'ID' point to the output
+	B[globalID] = A[globalID];
+}
+
+// Increment one bin per work item, spread evenly over the bins, which measures the atomic throughput ceiling of the intensity histograms
+kernel void atomicCalibration(global int* B, int binCount) {
+	// Get the global ID of the current item and store it in a variable
+	int globalID = get_global_id(0);
+
+	// Atomically increment the bin of the work item
+	atomic_inc(&B[globalID % binCount]);
+}
@@ -0,0 +1,853 @@
+/*
+Description
+- Checks every kernel of kernels/my_kernels.cl against a reference calculated on the host, on synthetic images and on the bundled test images.
+- The histograms, cumulative histograms, look-up tables and output images must match the reference exactly, for several bin counts, for every colour mode, for the tiled kernels over several tile shapes, for the persistent kernels, for the image kernels where the device supports them, and for the generic and the specialised kernels.
+- A repeated equalisation must reuse the kernels and every argument bound to them, and images of alternating sizes must reuse the pooled device buffers and pinned host memory.
+- Each kernel is then timed on a synthetic image and compared with the baseline stored for the device, failing when it is significantly slower.
+- The program exits with 0 when every check passes, 1 when any fails, and 77 when there is no OpenCL platform to test, which CTest reports as skipped.
+*/
+
+#include <array>
+#include <climits>
+#include <iomanip>
+
+#include "../include/HistogramEqualiser.h"
+
+using namespace cimg_library;
+
+void printHelp() {
+	std::cerr << "Application usage:" << std::endl;
+	std::cerr << "  -p : select platform (Default: 0)" << std::endl;
+	std::cerr << "  -d : select device (Default: 0)" << std::endl;
+	std::cerr << "  -i : directory holding the bundled test images (Default: .)" << std::endl;
+	std::cerr << "  -b : file of per-device timing baselines (Default: tests/baselines.csv)" << std::endl;
+	std::cerr << "  -r : record the timings as the baseline of the device instead of comparing them" << std::endl;
+	std::cerr << "  -t : tolerated slowdown as a fraction of the baseline (Default: 0.25)" << std::endl;
+	std::cerr << "  -n : timed repetitions of each kernel, of which the median is used (Default: 5)" << std::endl;
+	std::cerr << "  -s : size of the synthetic image that is timed, as WIDTHxHEIGHT (Default: 1024x1024)" << std::endl;
+	std::cerr << "  -c : only check correctness, skipping the timings" << std::endl;
+	std::cerr << "  -m : only time the kernels, skipping the correctness checks" << std::endl;
+	std::cerr << "  -h : print this message" << std::endl;
+}
+
+// Slowdowns smaller than this many nanoseconds are launch jitter rather than regressions, whatever the tolerance
+const cl_ulong timingSlack = 20000;
+
+// The host reference of one equalisation
+struct Reference {
+	vector<int> IH;
+	vector<int> CH;
+	vector<int> LUT;
+	vector<uint16_t> out;
+};
+
+// The binned histogram of a plane, as every intensity histogram kernel counts it
+vector<int> referenceHistogram(const uint16_t* plane, int pixelCount, int binCount, int increments) {
+	vector<int> histogram(binCount, 0);
+	for (int i = 0; i < pixelCount; i++) {
+		histogram[min(plane[i] / increments, binCount - 1)]++;
+	}
+	return histogram;
+}
+
+// The cumulative histogram, which the serial and Blelloch kernels calculate exclusively and the Hillis-Steele kernels inclusively
+vector<int> referenceScan(const vector<int>& histogram, int cumHistoChoice) {
+	bool exclusive = (cumHistoChoice == 1 || cumHistoChoice == 2);
+	vector<int> cumulative(histogram.size());
+	int total = 0;
+	for (size_t i = 0; i < histogram.size(); i++) {
+		cumulative[i] = exclusive ? total : total + histogram[i];
+		total += histogram[i];
+	}
+	return cumulative;
+}
+
+// The look-up table of the selected kernel, or of histogram matching when a target is given
+vector<int> referenceLookup(const vector<int>& cumulative, int cumHistoChoice, int lookupChoice, const EqualiserOptions& options) {
+	int binCount = options.binCount;
+	int maxIntensity = options.maxIntensity;
+	int increments = (maxIntensity + 1) / binCount;
+	vector<int> lut(binCount);
+
+	// Map each level onto the first target level whose cumulative proportion reaches it
+	if (!options.targetCDF.empty()) {
+		const vector<int>& target = options.targetCDF;
+		for (int i = 0; i < binCount; i++) {
+			int level = 0;
+			while (level < binCount - 1 && (cl_ulong)target[level] * cumulative[binCount - 1] < (cl_ulong)cumulative[i] * target[binCount - 1]) {
+				level++;
+			}
+			lut[i] = min(level * increments, maxIntensity);
+		}
+	}
+
+	// The fused kernel stretches from the smallest non-zero cumulative value, mapping an image of one level to zero
+	else if (cumHistoChoice == 5) {
+		int cdfMin = INT_MAX;
+		for (int value : cumulative) {
+			if (value > 0) {
+				cdfMin = min(cdfMin, value);
+			}
+		}
+		int denominator = cumulative[binCount - 1] - cdfMin;
+		for (int i = 0; i < binCount; i++) {
+			lut[i] = (denominator > 0) ? (int)((cl_ulong)max(cumulative[i] - cdfMin, 0) * maxIntensity / denominator) : 0;
+		}
+	}
+
+	// The double-precision tables divide by the last bin, or by the bin at the maximum intensity for the standardised one
+	else if (lookupChoice >= 1 && lookupChoice <= 3) {
+		int total = (lookupChoice == 1) ? cumulative[maxIntensity] : cumulative[binCount - 1];
+		for (int i = 0; i < binCount; i++) {
+			lut[i] = (int)(cumulative[i] * (double)maxIntensity / total);
+		}
+	}
+
+	// The fixed-point table divides exactly by the last bin
+	else {
+		cl_ulong total = max(cumulative[binCount - 1], 1);
+		for (int i = 0; i < binCount; i++) {
+			lut[i] = (int)((cl_ulong)cumulative[i] * maxIntensity / total);
+		}
+	}
+
+	return lut;
+}
+
+// Equalise an image on the host in the same way as the equaliser, following its choice of per-channel, YCbCr or greyscale processing
+Reference hostReference(const uint16_t* in, int width, int height, int channels, const EqualiserOptions& options) {
+	int pixelCount = width * height;
+	int binCount = options.binCount;
+	int increments = (options.maxIntensity + 1) / binCount;
+	bool perChannel = (channels == 3) && options.colourMode == "rgb" && options.targetCDF.empty();
+	bool matching = !options.targetCDF.empty();
+	int cumHistoChoice = perChannel ? 5 : (matching && options.cumHistoChoice <= 2) ? 4 : options.cumHistoChoice;
+
+	// Equalise the luma of RGB images that are not equalised per channel
+	CImg<unsigned short> imgYCbCr;
+	const uint16_t* plane = in;
+	if (channels == 3 && !perChannel) {
+		imgYCbCr.assign(in, width, height, 1, 3);
+		imgYCbCr.RGBtoYCbCr();
+		plane = imgYCbCr.data();
+	}
+
+	Reference reference;
+	int channelCount = perChannel ? 3 : 1;
+	reference.out.resize((size_t)channelCount * pixelCount);
+
+	for (int channel = 0; channel < channelCount; channel++) {
+		const uint16_t* values = plane + (size_t)channel * pixelCount;
+		vector<int> histogram = referenceHistogram(values, pixelCount, binCount, increments);
+		vector<int> cumulative = referenceScan(histogram, cumHistoChoice);
+		vector<int> lut = referenceLookup(cumulative, cumHistoChoice, options.lookupChoice, options);
+
+		for (int i = 0; i < pixelCount; i++) {
+			int bin = min(values[i] / increments, binCount - 1);
+			reference.out[(size_t)channel * pixelCount + i] = (uint16_t)lut[bin];
+		}
+
+		reference.IH.insert(reference.IH.end(), histogram.begin(), histogram.end());
+		reference.CH.insert(reference.CH.end(), cumulative.begin(), cumulative.end());
+		reference.LUT.insert(reference.LUT.end(), lut.begin(), lut.end());
+	}
+
+	// Convert the equalised luma back to RGB
+	if (!imgYCbCr.is_empty()) {
+		copy(reference.out.begin(), reference.out.end(), imgYCbCr.data());
+		imgYCbCr.YCbCrtoRGB();
+		reference.out.assign(imgYCbCr.data(), imgYCbCr.data() + imgYCbCr.size());
+	}
+
+	return reference;
+}
+
+// Compare a stage with its reference, printing the first difference
+template <typename T>
+bool compareStage(const string& label, const string& stage, const vector<T>& actual, const vector<T>& expected) {
+	if (actual.size() != expected.size()) {
+		std::cout << "FAIL " << label << ": " << stage << " holds " << actual.size() << " values, expected " << expected.size() << std::endl;
+		return false;
+	}
+
+	for (size_t i = 0; i < actual.size(); i++) {
+		if (actual[i] != expected[i]) {
+			std::cout << "FAIL " << label << ": " << stage << "[" << i << "] = " << actual[i] << ", expected " << expected[i] << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// The kernel combinations to check for a bin count and bit depth, changing one stage at a time from the variable histogram, double buffered scan, fixed-point table and variable back-projection
+vector<EqualiserOptions> kernelCombinations(const EqualiserOptions& base, bool doublePrecision) {
+	// The standardised kernels index by intensity, so they only apply when every intensity has a bin of its own
+	bool fullBins = (base.binCount == base.maxIntensity + 1);
+
+	// The Blelloch scan only handles powers of two
+	bool powerOfTwo = (base.binCount & (base.binCount - 1)) == 0;
+
+	vector<EqualiserOptions> combinations;
+	EqualiserOptions options = base;
+	options.intHistoChoice = 2;
+	options.cumHistoChoice = 4;
+	options.lookupChoice = 4;
+	options.backprojectChoice = 2;
+
+	for (int choice = 1; choice <= 3; choice++) {
+		if (choice != 1 || fullBins) {
+			combinations.push_back(options);
+			combinations.back().intHistoChoice = choice;
+		}
+	}
+	for (int choice = 1; choice <= 5; choice++) {
+		if ((choice != 2 || powerOfTwo) && choice != 4) {
+			combinations.push_back(options);
+			combinations.back().cumHistoChoice = choice;
+		}
+	}
+	for (int choice = 1; choice <= 4; choice++) {
+		if ((choice != 1 || fullBins) && (choice == 4 || doublePrecision)) {
+			combinations.push_back(options);
+			combinations.back().lookupChoice = choice;
+		}
+	}
+	for (int choice = 1; choice <= 3; choice++) {
+		if (choice != 1 || fullBins) {
+			combinations.push_back(options);
+			combinations.back().backprojectChoice = choice;
+		}
+	}
+
+	return combinations;
+}
+
+// Equalise an image and compare every stage with the host reference
+bool checkEqualisation(HistogramEqualiser& equaliser, const string& imageName, const CImg<unsigned short>& image, const EqualiserOptions& options) {
+	vector<uint16_t> output(image.size());
+	const EqualiserResult& result = equaliser.equalise(image.data(), output.data(), image.width(), image.height(), image.spectrum(), options);
+	Reference reference = hostReference(image.data(), image.width(), image.height(), image.spectrum(), options);
+
+	string label = imageName + ", " + to_string(options.binCount) + " bins, " + (options.specialise ? "specialised, " : "") + (image.spectrum() == 3 ? options.colourMode + ", " : "") +
+		result.intHistoFunction + " > " + result.cumHistoFunction + " > " + result.lookupFunction + " > " + result.backprojectFunction;
+
+	return compareStage(label, "IH", result.IH, reference.IH) && compareStage(label, "CH", result.CH, reference.CH) &&
+		compareStage(label, "LUT", result.LUT, reference.LUT) && compareStage(label, "output", output, reference.out);
+}
+
+// Equalise an image with the fixed-point look-up table and with the double-precision variable and local memory tables, whose tables must agree on the device
+// Every table divides by the last cumulative value, so they must agree after the exclusive scans as well as the inclusive ones
+bool checkLookupAgreement(HistogramEqualiser& equaliser, const string& imageName, const CImg<unsigned short>& image, const EqualiserOptions& options) {
+	vector<uint16_t> output(image.size());
+	EqualiserOptions fixedPoint = options;
+	fixedPoint.lookupChoice = 4;
+	vector<int> expected = equaliser.equalise(image.data(), output.data(), image.width(), image.height(), image.spectrum(), fixedPoint).LUT;
+
+	for (int lookupChoice : { 2, 3 }) {
+		EqualiserOptions doublePrecision = options;
+		doublePrecision.lookupChoice = lookupChoice;
+		const EqualiserResult& result = equaliser.equalise(image.data(), output.data(), image.width(), image.height(), image.spectrum(), doublePrecision);
+		string label = imageName + ", " + to_string(options.binCount) + " bins, " + (options.specialise ? "specialised, " : "") + result.cumHistoFunction + " > " + result.lookupFunction + " against lookupTable4";
+		if (!compareStage(label, "LUT", result.LUT, expected)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Equalise an RGB image through a device colour space, whose floating-point conversions are not reproduced on the host
+// The histogram must still count every pixel, and the scan and look-up table must match the reference of the histogram that the device produced
+bool checkColourSpace(HistogramEqualiser& equaliser, const string& imageName, const CImg<unsigned short>& image, const EqualiserOptions& options) {
+	vector<uint16_t> output(image.size());
+	const EqualiserResult& result = equaliser.equalise(image.data(), output.data(), image.width(), image.height(), image.spectrum(), options);
+	int pixelCount = image.width() * image.height();
+	string label = imageName + ", " + to_string(options.binCount) + " bins, " + (options.specialise ? "specialised, " : "") + result.colourToFunction + " > " + result.colourFromFunction;
+
+	int counted = 0;
+	for (int count : result.IH) {
+		counted += count;
+	}
+	if (counted != pixelCount) {
+		std::cout << "FAIL " << label << ": IH counts " << counted << " pixels, expected " << pixelCount << std::endl;
+		return false;
+	}
+
+	vector<int> cumulative = referenceScan(result.IH, options.cumHistoChoice);
+	vector<int> lut = referenceLookup(cumulative, options.cumHistoChoice, options.lookupChoice, options);
+	return compareStage(label, "CH", result.CH, cumulative) && compareStage(label, "LUT", result.LUT, lut);
+}
+
+// Build the target cumulative histogram of an RGB reference, which must scan the channel that the colour mode equalises, as counted by the equaliser on the same image
+bool checkReferenceTarget(HistogramEqualiser& equaliser, const string& imageName, const CImg<unsigned short>& image, const EqualiserOptions& options) {
+	vector<uint16_t> output(image.size());
+	vector<int> expected = referenceScan(equaliser.equalise(image.data(), output.data(), image.width(), image.height(), image.spectrum(), options).IH, 4);
+	vector<int> target = equaliser.targetCDF(image.data(), image.width(), image.height(), image.spectrum(), options);
+	string label = imageName + ", " + to_string(options.binCount) + " bins, " + (options.specialise ? "specialised, " : "") + options.colourMode + " reference";
+	return compareStage(label, "target", target, expected);
+}
+
+// Build the target of an RGB reference of another size after equalising an RGB image, whose YCbCr conversion is held in the pinned memory of the equaliser
+bool checkReferenceSize(HistogramEqualiser& equaliser, const CImg<unsigned short>& image, const CImg<unsigned short>& reference) {
+	EqualiserOptions options;
+	vector<uint16_t> output(image.size()), referenceOutput(reference.size());
+	vector<int> expected = referenceScan(equaliser.equalise(reference.data(), referenceOutput.data(), reference.width(), reference.height(), reference.spectrum(), options).IH, 4);
+	equaliser.equalise(image.data(), output.data(), image.width(), image.height(), image.spectrum(), options);
+
+	string label = "synthetic " + to_string(reference.width()) + "x" + to_string(reference.height()) + " reference after a " + to_string(image.width()) + "x" + to_string(image.height()) + " image";
+	vector<int> target;
+	try {
+		target = equaliser.targetCDF(reference.data(), reference.width(), reference.height(), reference.spectrum(), options);
+	}
+	catch (const CImgException& err) {
+		std::cout << "FAIL " << label << ": " << err.what() << std::endl;
+		return false;
+	}
+	return compareStage(label, "target", target, expected);
+}
+
+// Equalise an image twice with the same options, where the second equalisation must create no kernels, bind no arguments and give the same output
+// A histogram matching target must not be written again when it is unchanged
+bool checkArgumentReuse(HistogramEqualiser& equaliser, const string& imageName, const CImg<unsigned short>& image, const EqualiserOptions& options) {
+	vector<uint16_t> first(image.size()), second(image.size());
+	equaliser.equalise(image.data(), first.data(), image.width(), image.height(), image.spectrum(), options);
+	int kernelCount = equaliser.getKernels().getKernelCount();
+	cl_ulong argumentsSet = equaliser.getKernels().getArgumentsSet();
+	const EqualiserResult& result = equaliser.equalise(image.data(), second.data(), image.width(), image.height(), image.spectrum(), options);
+
+	string label = imageName + ", repeated";
+	int created = equaliser.getKernels().getKernelCount() - kernelCount;
+	cl_ulong bound = equaliser.getKernels().getArgumentsSet() - argumentsSet;
+	if (created != 0 || bound != 0) {
+		std::cout << "FAIL " << label << ": created " << created << " kernels and bound " << bound << " arguments" << std::endl;
+		return false;
+	}
+	for (const EqualiserTransfer& transfer : result.transfers) {
+		if (transfer.stage == "Target Histogram") {
+			std::cout << "FAIL " << label << ": wrote the unchanged target cumulative histogram again" << std::endl;
+			return false;
+		}
+	}
+	return compareStage(label, "output", second, first);
+}
+
+// Equalise images of alternating sizes, where every equalisation after the first round must take its buffers from the pool without allocating
+bool checkBufferReuse(HistogramEqualiser& equaliser, const vector<CImg<unsigned short>>& images, int rounds) {
+	for (int round = 0; round < rounds; round++) {
+		for (const CImg<unsigned short>& image : images) {
+			string label = "synthetic " + to_string(image.width()) + "x" + to_string(image.height()) + ", round " + to_string(round + 1);
+			int allocations = equaliser.getAllocationCount();
+			if (!checkEqualisation(equaliser, label, image, EqualiserOptions())) {
+				return false;
+			}
+			if (round > 0 && equaliser.getAllocationCount() != allocations) {
+				std::cout << "FAIL " << label << ": allocated " << equaliser.getAllocationCount() - allocations << " device buffers for an image size seen before" << std::endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Equalise images from the pinned input memory of the equaliser into its pinned output memory, where both image transfers must be pinned
+// Every equalisation after the first round must reuse the pinned memory without allocating
+bool checkPinnedStaging(HistogramEqualiser& equaliser, const vector<CImg<unsigned short>>& images, int rounds) {
+	for (int round = 0; round < rounds; round++) {
+		for (const CImg<unsigned short>& image : images) {
+			string label = "synthetic " + to_string(image.width()) + "x" + to_string(image.height()) + "x" + to_string(image.spectrum()) + " staged, round " + to_string(round + 1);
+			cl_ulong allocations = equaliser.getHostPool().getStatistics().allocations;
+
+			uint16_t* in = equaliser.stagingInput(image.size());
+			copy(image.begin(), image.end(), in);
+			uint16_t* out = equaliser.stagingOutput(image.size());
+			const EqualiserResult& result = equaliser.equalise(in, out, image.width(), image.height(), image.spectrum(), EqualiserOptions());
+
+			for (const EqualiserTransfer& transfer : result.transfers) {
+				if ((transfer.stage == "Input Image" || transfer.stage == "Output Image") && !transfer.pinned) {
+					std::cout << "FAIL " << label << ": the " << transfer.command << " of the " << transfer.stage << " was not pinned" << std::endl;
+					return false;
+				}
+			}
+			if (round > 0 && equaliser.getHostPool().getStatistics().allocations != allocations) {
+				std::cout << "FAIL " << label << ": allocated " << equaliser.getHostPool().getStatistics().allocations - allocations << " pinned buffers for an image size seen before" << std::endl;
+				return false;
+			}
+
+			Reference reference = hostReference(image.data(), image.width(), image.height(), image.spectrum(), EqualiserOptions());
+			if (!compareStage(label, "output", vector<uint16_t>(out, out + image.size()), reference.out)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Check every kernel combination and colour mode on an image, returning the number of failed runs
+int checkImage(HistogramEqualiser& equaliser, const string& imageName, const CImg<unsigned short>& image, const vector<int>& binCounts, int& runs) {
+	int failures = 0;
+	int maxIntensity = (image.max() <= 255) ? 255 : 65535;
+
+	// Check the generic program and the program specialised for the bin count and bit depth
+	for (bool specialise : { false, true }) {
+		for (int binCount : binCounts) {
+			EqualiserOptions base;
+			base.binCount = binCount;
+			base.maxIntensity = maxIntensity;
+			base.specialise = specialise;
+
+			// Equalise greyscale images and the luma of RGB images with every combination of kernels
+			for (const EqualiserOptions& options : kernelCombinations(base, equaliser.hasDoublePrecision())) {
+				failures += checkEqualisation(equaliser, imageName, image, options) ? 0 : 1;
+				runs++;
+			}
+
+			// The standardised kernels without a bin for every intensity level, and the Blelloch scan without a power of two bins, must fall back to kernels that can run
+			if (binCount != maxIntensity + 1) {
+				EqualiserOptions unsupported = base;
+				unsupported.intHistoChoice = 1;
+				unsupported.cumHistoChoice = 2;
+				unsupported.backprojectChoice = 1;
+				failures += checkEqualisation(equaliser, imageName, image, unsupported) ? 0 : 1;
+				runs++;
+			}
+
+			// Compare the fixed-point look-up table with the double-precision tables after every scan that builds a separate table
+			if (equaliser.hasDoublePrecision()) {
+				bool powerOfTwo = (binCount & (binCount - 1)) == 0;
+				for (int cumHistoChoice : { 1, 2, 3, 4 }) {
+					if (cumHistoChoice == 2 && !powerOfTwo) {
+						continue;
+					}
+					EqualiserOptions agreement = base;
+					agreement.cumHistoChoice = cumHistoChoice;
+					failures += checkLookupAgreement(equaliser, imageName, image, agreement) ? 0 : 1;
+					runs++;
+				}
+			}
+
+			// Match the histogram to a ramp, which has a flat cumulative histogram
+			// The exclusive serial and Blelloch scans must be replaced by an inclusive scan, which the reference does as well
+			CImg<unsigned short> ramp(256, 64, 1, 1);
+			vector<uint16_t> rampPlane(ramp.size());
+			mt19937 generator(1);
+			GenerateSyntheticPlane(rampPlane, 0, rampPlane.size(), "ramp", maxIntensity, generator);
+			for (int cumHistoChoice : { 1, 2, 4 }) {
+				EqualiserOptions matching = base;
+				matching.cumHistoChoice = cumHistoChoice;
+				matching.backprojectChoice = 2;
+				matching.targetCDF = referenceScan(referenceHistogram(rampPlane.data(), (int)rampPlane.size(), binCount, (maxIntensity + 1) / binCount), 4);
+				failures += checkEqualisation(equaliser, imageName, image, matching) ? 0 : 1;
+				runs++;
+			}
+
+			// Equalise greyscale images and the luma of RGB images over row tiles, including tiles that divide neither dimension and several pixels per work item
+			for (const array<int, 3>& shape : { array<int, 3>{ 16, 16, 1 }, array<int, 3>{ 7, 3, 4 } }) {
+				EqualiserOptions tiled = base;
+				tiled.tiledLaunch = true;
+				tiled.tileWidth = shape[0];
+				tiled.tileHeight = shape[1];
+				tiled.itemsPerThread = shape[2];
+				failures += checkEqualisation(equaliser, imageName, image, tiled) ? 0 : 1;
+				runs++;
+
+				// Run the image kernels over the same tiles, on devices with 16-bit single-channel images
+				if (equaliser.hasImageSupport()) {
+					EqualiserOptions imagePipeline = tiled;
+					imagePipeline.imagePipeline = true;
+					failures += checkEqualisation(equaliser, imageName, image, imagePipeline) ? 0 : 1;
+					runs++;
+				}
+			}
+
+			// Equalise with the persistent kernels, where one work group per compute unit makes every work item stride over many pixels
+			for (int groups : { 1, 4 }) {
+				EqualiserOptions persistent = base;
+				persistent.persistentLaunch = true;
+				persistent.groupsPerComputeUnit = groups;
+				failures += checkEqualisation(equaliser, imageName, image, persistent) ? 0 : 1;
+				runs++;
+			}
+
+			if (image.spectrum() == 3) {
+				// Equalise every channel with the per-channel kernels
+				EqualiserOptions perChannel = base;
+				perChannel.colourMode = "rgb";
+				failures += checkEqualisation(equaliser, imageName, image, perChannel) ? 0 : 1;
+				runs++;
+
+				// Equalise the intensity of the device colour spaces
+				for (string colourMode : { "hsv", "hsl", "lab" }) {
+					EqualiserOptions colour = base;
+					colour.colourMode = colourMode;
+					colour.cumHistoChoice = 4;
+					colour.backprojectChoice = 2;
+					failures += checkColourSpace(equaliser, imageName, image, colour) ? 0 : 1;
+					runs++;
+				}
+
+				// Build the matching target of the image on the channel of every colour mode that it can be matched on
+				for (string colourMode : { "ycbcr", "hsv", "hsl", "lab" }) {
+					EqualiserOptions reference = base;
+					reference.colourMode = colourMode;
+					failures += checkReferenceTarget(equaliser, imageName, image, reference) ? 0 : 1;
+					runs++;
+				}
+
+				// The tiled kernels follow the device colour conversions on the intensity channel they leave in the input buffer
+				EqualiserOptions tiledColour = base;
+				tiledColour.colourMode = "hsv";
+				tiledColour.cumHistoChoice = 4;
+				tiledColour.tiledLaunch = true;
+				tiledColour.itemsPerThread = 3;
+				failures += checkColourSpace(equaliser, imageName, image, tiledColour) ? 0 : 1;
+				runs++;
+			}
+		}
+	}
+
+	return failures;
+}
+
+// The median duration of each kernel over repeated equalisations of synthetic greyscale and RGB images, in nanoseconds
+map<string, cl_ulong> measureKernels(HistogramEqualiser& equaliser, int width, int height, int repetitions) {
+	mt19937 generator(2);
+	CImg<unsigned short> grey(width, height, 1, 1), colour(width, height, 1, 3);
+	vector<uint16_t> planes((size_t)3 * width * height);
+	GenerateSyntheticPlane(planes, 0, grey.size(), "gaussian", 255, generator);
+	copy(planes.begin(), planes.begin() + grey.size(), grey.data());
+	for (int channel = 0; channel < 3; channel++) {
+		GenerateSyntheticPlane(planes, (size_t)channel * grey.size(), grey.size(), "uniform", 255, generator);
+	}
+	copy(planes.begin(), planes.end(), colour.data());
+
+	// Time the greyscale combinations, the tiled, persistent and image kernels, the per-channel kernels and the colour space conversions
+	vector<pair<const CImg<unsigned short>*, EqualiserOptions>> runs;
+	for (const EqualiserOptions& options : kernelCombinations(EqualiserOptions(), equaliser.hasDoublePrecision())) {
+		runs.push_back({ &grey, options });
+	}
+	EqualiserOptions tiled;
+	tiled.tiledLaunch = true;
+	runs.push_back({ &grey, tiled });
+	EqualiserOptions persistent;
+	persistent.persistentLaunch = true;
+	runs.push_back({ &grey, persistent });
+	if (equaliser.hasImageSupport()) {
+		EqualiserOptions options;
+		options.imagePipeline = true;
+		runs.push_back({ &grey, options });
+	}
+	for (string colourMode : { "rgb", "hsv", "hsl", "lab" }) {
+		EqualiserOptions options;
+		options.colourMode = colourMode;
+		options.cumHistoChoice = 4;
+		runs.push_back({ &colour, options });
+	}
+
+	map<string, vector<cl_ulong>> durations;
+	auto duration = [](const cl::Event& event) { return event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>(); };
+	for (const auto& run : runs) {
+		vector<uint16_t> output(run.first->size());
+		for (int repetition = 0; repetition <= repetitions; repetition++) {
+			const EqualiserResult& result = equaliser.equalise(run.first->data(), output.data(), run.first->width(), run.first->height(), run.first->spectrum(), run.second);
+
+			// The first run is a warm-up
+			if (repetition == 0) {
+				continue;
+			}
+
+			durations[result.intHistoFunction].push_back(duration(result.intHistoEvent));
+			durations[result.cumHistoFunction].push_back(duration(result.cumHistoEvent));
+			if (result.lookupFunction != result.cumHistoFunction) {
+				durations[result.lookupFunction].push_back(duration(result.lookupEvent));
+			}
+			durations[result.backprojectFunction].push_back(duration(result.backprojectEvent));
+			if (!result.colourToFunction.empty()) {
+				durations[result.colourToFunction].push_back(duration(result.colourToEvent));
+				durations[result.colourFromFunction].push_back(duration(result.colourFromEvent));
+			}
+		}
+	}
+
+	map<string, cl_ulong> medians;
+	for (auto& kernel : durations) {
+		nth_element(kernel.second.begin(), kernel.second.begin() + kernel.second.size() / 2, kernel.second.end());
+		medians[kernel.first] = kernel.second[kernel.second.size() / 2];
+	}
+	return medians;
+}
+
+// Read the baselines of every device, keyed by device and then by kernel
+map<string, map<string, cl_ulong>> loadBaselines(const string& fileName) {
+	map<string, map<string, cl_ulong>> baselines;
+	ifstream file(fileName);
+	string line;
+
+	// Skip the header
+	getline(file, line);
+	while (getline(file, line)) {
+		stringstream row(line);
+		string device, kernel, nanoseconds;
+		if (getline(row, device, ',') && getline(row, kernel, ',') && getline(row, nanoseconds)) {
+			baselines[device][kernel] = stoull(nanoseconds);
+		}
+	}
+	return baselines;
+}
+
+// Write the baselines of every device
+bool saveBaselines(const string& fileName, const map<string, map<string, cl_ulong>>& baselines) {
+	ofstream file(fileName);
+	if (!file) {
+		return false;
+	}
+	file << "device,kernel,nanoseconds" << std::endl;
+	for (const auto& device : baselines) {
+		for (const auto& kernel : device.second) {
+			file << device.first << "," << kernel.first << "," << kernel.second << std::endl;
+		}
+	}
+	return (bool)file;
+}
+
+// Check every kernel against the host reference on the synthetic and bundled images, returning the number of failed equalisations
+int checkCorrectness(HistogramEqualiser& equaliser, const string& imageDir) {
+	int runs = 0;
+	int failures = 0;
+	vector<int> binCounts = { 256, 64, 100 };
+
+	// Synthetic greyscale images with an odd size, so that no kernel can rely on the pixel count being a multiple of its work-group size
+	mt19937 generator(3);
+	for (int bitDepth : { 8, 16 }) {
+		int maxIntensity = (bitDepth == 16) ? 65535 : 255;
+		for (string distribution : { "uniform", "gaussian", "spike", "ramp" }) {
+			CImg<unsigned short> image(257, 131, 1, 1);
+			vector<uint16_t> plane(image.size());
+			GenerateSyntheticPlane(plane, 0, plane.size(), distribution, maxIntensity, generator);
+			copy(plane.begin(), plane.end(), image.data());
+
+			int before = runs;
+			int failed = checkImage(equaliser, "synthetic " + distribution + " " + to_string(bitDepth) + "-bit", image, binCounts, runs);
+			std::cout << "synthetic " << distribution << " " << bitDepth << "-bit: " << runs - before - failed << "/" << runs - before << " passed" << std::endl;
+			failures += failed;
+		}
+	}
+
+	// A synthetic RGB image
+	{
+		CImg<unsigned short> image(257, 131, 1, 3);
+		vector<uint16_t> planes(image.size());
+		for (int channel = 0; channel < 3; channel++) {
+			GenerateSyntheticPlane(planes, (size_t)channel * image.width() * image.height(), (size_t)image.width() * image.height(), "uniform", 255, generator);
+		}
+		copy(planes.begin(), planes.end(), image.data());
+		int before = runs;
+		int failed = checkImage(equaliser, "synthetic uniform RGB", image, binCounts, runs);
+		std::cout << "synthetic uniform RGB: " << runs - before - failed << "/" << runs - before << " passed" << std::endl;
+		failures += failed;
+	}
+
+	// The bundled images, which must all be present
+	for (string imageName : { "test.pgm", "test.ppm", "test_16bit2.pgm", "test_large.ppm", "colour_test.ppm" }) {
+		CImg<unsigned short> image;
+		try {
+			image.load((imageDir + "/" + imageName).c_str());
+		}
+		catch (const CImgException&) {
+			std::cout << "FAIL " << imageName << ": cannot be loaded from " << imageDir << std::endl;
+			failures++;
+			continue;
+		}
+
+		int before = runs;
+		int failed = checkImage(equaliser, imageName, image, binCounts, runs);
+		std::cout << imageName << ": " << runs - before - failed << "/" << runs - before << " passed" << std::endl;
+		failures += failed;
+	}
+
+	// Equalisations repeated with the same options, which must reuse the kernels and their arguments, including for the specialised program
+	{
+		CImg<unsigned short> image(257, 131, 1, 1);
+		vector<uint16_t> plane(image.size());
+		GenerateSyntheticPlane(plane, 0, plane.size(), "uniform", 255, generator);
+		copy(plane.begin(), plane.end(), image.data());
+
+		EqualiserOptions specialised;
+		specialised.specialise = true;
+		EqualiserOptions matching;
+		vector<uint16_t> ramp(image.size());
+		GenerateSyntheticPlane(ramp, 0, ramp.size(), "ramp", 255, generator);
+		matching.targetCDF = referenceScan(referenceHistogram(ramp.data(), (int)ramp.size(), matching.binCount, 1), 4);
+		int failed = 0;
+		for (const EqualiserOptions& options : { EqualiserOptions(), specialised, matching }) {
+			failed += checkArgumentReuse(equaliser, "synthetic uniform 8-bit", image, options) ? 0 : 1;
+			runs++;
+		}
+		std::cout << "argument reuse: " << 3 - failed << "/3 passed" << std::endl;
+		failures += failed;
+	}
+
+	// Images of alternating sizes, which must be served from the buffer pool once each size has been seen
+	{
+		vector<CImg<unsigned short>> images = { CImg<unsigned short>(257, 131, 1, 1), CImg<unsigned short>(64, 32, 1, 1), CImg<unsigned short>(1031, 17, 1, 1) };
+		for (CImg<unsigned short>& image : images) {
+			vector<uint16_t> plane(image.size());
+			GenerateSyntheticPlane(plane, 0, plane.size(), "gaussian", 255, generator);
+			copy(plane.begin(), plane.end(), image.data());
+		}
+		bool passed = checkBufferReuse(equaliser, images, 3);
+		std::cout << "buffer reuse: " << (passed ? 1 : 0) << "/1 passed" << std::endl;
+		failures += passed ? 0 : 1;
+		runs++;
+	}
+
+	// Greyscale and RGB images staged in pinned memory, where the RGB image is converted to YCbCr in the pinned memory of the equaliser
+	{
+		vector<CImg<unsigned short>> images = { CImg<unsigned short>(257, 131, 1, 1), CImg<unsigned short>(1031, 17, 1, 3) };
+		for (CImg<unsigned short>& image : images) {
+			vector<uint16_t> planes(image.size());
+			GenerateSyntheticPlane(planes, 0, planes.size(), "uniform", 255, generator);
+			copy(planes.begin(), planes.end(), image.data());
+		}
+		bool passed = checkPinnedStaging(equaliser, images, 3);
+		std::cout << "pinned staging: " << (passed ? 1 : 0) << "/1 passed" << std::endl;
+		failures += passed ? 0 : 1;
+		runs++;
+	}
+
+	// An RGB reference of another size than the last RGB image, which must not be converted in the pinned memory of the equaliser
+	{
+		CImg<unsigned short> image(8, 8, 1, 3), reference(4, 4, 1, 3);
+		vector<uint16_t> planes(image.size());
+		GenerateSyntheticPlane(planes, 0, planes.size(), "uniform", 255, generator);
+		copy(planes.begin(), planes.end(), image.data());
+		copy(planes.begin(), planes.begin() + reference.size(), reference.data());
+		bool passed = checkReferenceSize(equaliser, image, reference);
+		std::cout << "reference size: " << (passed ? 1 : 0) << "/1 passed" << std::endl;
+		failures += passed ? 0 : 1;
+		runs++;
+	}
+
+	std::cout << std::endl << "Correctness: " << failures << " of " << runs << " equalisations failed" << std::endl;
+	return failures;
+}
+
+int main(int argc, char** argv) {
+	int platformID = 0;
+	int deviceID = 0;
+	string imageDir = ".";
+	string baselineFile = "tests/baselines.csv";
+	bool record = false;
+	double tolerance = 0.25;
+	int repetitions = 5;
+	string timingSize = "1024x1024";
+	bool correctnessOnly = false;
+	bool timingOnly = false;
+
+	for (int i = 1; i < argc; i++) {
+		if ((strcmp(argv[i], "-p") == 0) && (i < (argc - 1))) { platformID = atoi(argv[++i]); }
+		else if ((strcmp(argv[i], "-d") == 0) && (i < (argc - 1))) { deviceID = atoi(argv[++i]); }
+		else if ((strcmp(argv[i], "-i") == 0) && (i < (argc - 1))) { imageDir = argv[++i]; }
+		else if ((strcmp(argv[i], "-b") == 0) && (i < (argc - 1))) { baselineFile = argv[++i]; }
+		else if (strcmp(argv[i], "-r") == 0) { record = true; }
+		else if ((strcmp(argv[i], "-t") == 0) && (i < (argc - 1))) { tolerance = atof(argv[++i]); }
+		else if ((strcmp(argv[i], "-n") == 0) && (i < (argc - 1))) { repetitions = atoi(argv[++i]); }
+		else if ((strcmp(argv[i], "-s") == 0) && (i < (argc - 1))) { timingSize = argv[++i]; }
+		else if (strcmp(argv[i], "-c") == 0) { correctnessOnly = true; }
+		else if (strcmp(argv[i], "-m") == 0) { timingOnly = true; }
+		else if (strcmp(argv[i], "-h") == 0) { printHelp(); return 0; }
+	}
+
+	// Skip rather than fail on machines without an OpenCL platform
+	vector<cl::Platform> platforms;
+	try {
+		cl::Platform::get(&platforms);
+	}
+	catch (const cl::Error&) {
+	}
+	if (platforms.empty()) {
+		std::cout << "SKIPPED: no OpenCL platform" << std::endl;
+		return 77;
+	}
+
+	cimg::exception_mode(0);
+
+	try {
+		HistogramEqualiser equaliser(platformID, deviceID);
+
+		// Baselines are stored per device, so commas are removed from the name to keep the file a plain CSV
+		string deviceName = GetDeviceName(platformID, deviceID);
+		replace(deviceName.begin(), deviceName.end(), ',', ' ');
+		std::cout << "Running on " << GetPlatformName(platformID) << ", " << deviceName << std::endl << std::endl;
+
+		/*
+		---------------- CORRECTNESS ----------------
+		*/
+
+		int failures = timingOnly ? 0 : checkCorrectness(equaliser, imageDir);
+
+		/*
+		---------------- PERFORMANCE ----------------
+		*/
+
+		int slower = 0, unmeasured = 0;
+		if (!correctnessOnly) {
+			int width = 0, height = 0;
+			if (sscanf(timingSize.c_str(), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+				std::cerr << "ERROR: invalid size " << timingSize << std::endl;
+				return 1;
+			}
+
+			map<string, cl_ulong> medians = measureKernels(equaliser, width, height, max(repetitions, 1));
+			map<string, map<string, cl_ulong>> baselines = loadBaselines(baselineFile);
+			map<string, cl_ulong>& baseline = baselines[deviceName];
+
+			std::cout << std::endl << left << setw(26) << "Kernel" << right << setw(16) << "Baseline [ns]" << setw(16) << "Median [ns]" << setw(12) << "Change" << "  Status" << std::endl;
+			for (const auto& kernel : medians) {
+				auto stored = baseline.find(kernel.first);
+				std::cout << left << setw(26) << kernel.first << right << setw(16) << (stored != baseline.end() ? to_string(stored->second) : "-") << setw(16) << kernel.second;
+
+				if (record || stored == baseline.end()) {
+					std::cout << setw(12) << "-" << "  " << (record ? "recorded" : "NO BASELINE") << std::endl;
+					unmeasured += record ? 0 : 1;
+					continue;
+				}
+
+				double change = (double)kernel.second / max(stored->second, (cl_ulong)1) - 1.0;
+				bool regressed = change > tolerance && kernel.second > stored->second + timingSlack;
+				slower += regressed ? 1 : 0;
+				std::cout << setw(11) << fixed << setprecision(1) << change * 100.0 << "%" << "  " << (regressed ? "SLOWER" : "ok") << std::endl;
+			}
+
+			if (record) {
+				baseline = medians;
+				if (!saveBaselines(baselineFile, baselines)) {
+					std::cerr << "ERROR: " << baselineFile << " could not be written" << std::endl;
+					return 1;
+				}
+				std::cout << std::endl << "Baseline of " << deviceName << " written to " << baselineFile << std::endl;
+			}
+			else {
+				std::cout << std::endl << "Performance: " << slower << " kernels slower than the baseline by more than " << tolerance * 100.0 << "%" << std::endl;
+			}
+
+			// Kernels without a baseline cannot regress, so the timings are reported as skipped rather than passed
+			if (unmeasured > 0) {
+				std::cout << "SKIPPED: " << unmeasured << " kernels have no baseline for " << deviceName << " in " << baselineFile << ", record one with -r" << std::endl;
+			}
+		}
+
+		if (failures > 0 || slower > 0) {
+			return 1;
+		}
+		return (unmeasured > 0) ? 77 : 0;
+	}
+
+	catch (const cl::Error& err) {
+		std::cerr << "ERROR: " << err.what() << ", " << getErrorString(err.err()) << std::endl;
+	}
+	catch (const CImgException& err) {
+		std::cerr << "ERROR: " << err.what() << std::endl;
+	}
+
+	return 1;
+}
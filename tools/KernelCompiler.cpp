@@ -0,0 +1,68 @@
+/*
+Description
+- Compiles a kernel file for one device and writes the device binary, so that the CMake build can embed it and the programs skip compiling the source at startup.
+- The binary only loads on the same device and driver, and the programs build the source instead on any other.
+*/
+
+#include "../include/Utils.h"
+
+void printHelp() {
+	std::cerr << "Application usage:" << std::endl;
+	std::cerr << "  -p : select platform (Default: 0)" << std::endl;
+	std::cerr << "  -d : select device (Default: 0)" << std::endl;
+	std::cerr << "  -l : list all platforms and devices" << std::endl;
+	std::cerr << "  -i : kernel file to compile (Default: kernels/my_kernels.cl)" << std::endl;
+	std::cerr << "  -o : file to write the device binary to (Default: my_kernels.bin)" << std::endl;
+	std::cerr << "  -h : print this message" << std::endl;
+}
+
+int main(int argc, char** argv) {
+	int platformID = 0;
+	int deviceID = 0;
+	string inputFile = "kernels/my_kernels.cl";
+	string outputFile = "my_kernels.bin";
+
+	for (int i = 1; i < argc; i++) {
+		if ((strcmp(argv[i], "-p") == 0) && (i < (argc - 1))) { platformID = atoi(argv[++i]); }
+		else if ((strcmp(argv[i], "-d") == 0) && (i < (argc - 1))) { deviceID = atoi(argv[++i]); }
+		else if (strcmp(argv[i], "-l") == 0) { std::cout << ListPlatformsDevices() << std::endl; }
+		else if ((strcmp(argv[i], "-i") == 0) && (i < (argc - 1))) { inputFile = argv[++i]; }
+		else if ((strcmp(argv[i], "-o") == 0) && (i < (argc - 1))) { outputFile = argv[++i]; }
+		else if (strcmp(argv[i], "-h") == 0) { printHelp(); return 0; }
+	}
+
+	try {
+		cl::Context context = GetContext(platformID, deviceID);
+		cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+
+		// Build the source without options, as the programs do
+		cl::Program::Sources sources;
+		AddSources(sources, inputFile);
+		cl::Program program(context, sources);
+		try {
+			program.build();
+		}
+		catch (const cl::Error& err) {
+			std::cerr << "Build Log:\t " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << std::endl;
+			throw err;
+		}
+
+		// The context has one device, so the program has one binary
+		vector<vector<unsigned char>> binaries = program.getInfo<CL_PROGRAM_BINARIES>();
+		ofstream file(outputFile, ios::binary);
+		file.write((const char*)binaries[0].data(), binaries[0].size());
+		if (!file) {
+			std::cerr << "ERROR: " << outputFile << " could not be written" << std::endl;
+			return 1;
+		}
+
+		std::cout << "Compiled " << inputFile << " for " << GetDeviceName(platformID, deviceID) << " into " << outputFile << " (" << binaries[0].size() << " bytes)" << std::endl;
+	}
+
+	catch (const cl::Error& err) {
+		std::cerr << "ERROR: " << err.what() << ", " << getErrorString(err.err()) << std::endl;
+		return 1;
+	}
+
+	return 0;
+}